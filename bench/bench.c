@@ -0,0 +1,205 @@
+/**
+ * Microbenchmarks for the C11 threads compatibility wrapper for the macOS(r)
+ * operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ */
+
+// Compares the wrapper (or native threads.h if BENCH_NATIVE_THREADS is defined) to direct pthread calls, see README
+// for how to build. Each result is printed as one JSON object per line to stdout:
+// {"benchmark":..., "impl":..., "threads":..., "ops":..., "nanos":..., "nanos_per_op":...}
+//
+// usage: bench [max_threads [iterations [rounds]]]
+//   max_threads  highest number of threads for contended locking, starting at 2 (default 8)
+//   iterations   lock operations per throughput benchmark (default 1000000)
+//   rounds       repetitions of latency and thread benchmarks (default 1000)
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#ifdef BENCH_NATIVE_THREADS
+#include <threads.h>
+#define BENCH_C11_IMPL "native"
+#else
+#include "../threads_macos_compat.h"
+#define BENCH_C11_IMPL "threads_macos_compat"
+#endif
+
+#define BENCH_MAX_THREADS (64)
+#define BENCH_NANOS_PER_SECOND (1000000000ULL)
+
+// time the mutex is held after the waiter announced itself, so it surely blocks before being released
+#define BENCH_TIMEDLOCK_HOLD_NANOS (100000)
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            exit(1); \
+        } \
+    } while (0)
+
+static unsigned long long now_nanos() {
+    struct timespec now = {0};
+    CHECK(!clock_gettime(CLOCK_MONOTONIC, &now));
+
+    return (unsigned long long) now.tv_sec * BENCH_NANOS_PER_SECOND + (unsigned long long) now.tv_nsec;
+}
+
+static struct timespec utc_deadline(unsigned int seconds) {
+    struct timespec deadline = {0};
+    CHECK(timespec_get(&deadline, TIME_UTC));
+    deadline.tv_sec += seconds;
+
+    return deadline;
+}
+
+static void wait_for(atomic_uint *value, unsigned int expected) {
+    // yielding instead of pausing so benchmarks also complete on machines with less cores than threads
+    while (atomic_load_explicit(value, memory_order_acquire) != expected) {
+        sched_yield();
+    }
+}
+
+static void report(const char *benchmark, const char *impl, unsigned int threads, unsigned long long ops, unsigned long long nanos) {
+    printf("{\"benchmark\":\"%s\",\"impl\":\"%s\",\"threads\":%u,\"ops\":%llu,\"nanos\":%llu,\"nanos_per_op\":%.2f}\n",
+           benchmark, impl, threads, ops, nanos, ops ? ((double) nanos / (double) ops) : 0.0);
+    fflush(stdout);
+}
+
+// C11 threads: the wrapper or the native implementation
+#define BENCH_IMPL BENCH_C11_IMPL
+#define BENCH_FN(name) name##_c11
+#define bench_mutex_t mtx_t
+#define bench_cond_t cnd_t
+#define bench_thread_t thrd_t
+#define BENCH_MUTEX_INIT(mutex) CHECK(mtx_init(&(mutex), mtx_plain) == thrd_success)
+#define BENCH_TIMED_MUTEX_INIT(mutex) CHECK(mtx_init(&(mutex), mtx_timed) == thrd_success)
+#define BENCH_MUTEX_DESTROY(mutex) mtx_destroy(&(mutex))
+#define BENCH_LOCK(mutex) CHECK(mtx_lock(&(mutex)) == thrd_success)
+#define BENCH_UNLOCK(mutex) CHECK(mtx_unlock(&(mutex)) == thrd_success)
+#define BENCH_HAS_TIMEDLOCK 1
+#define BENCH_TIMEDLOCK(mutex, deadline) CHECK(mtx_timedlock(&(mutex), (deadline)) == thrd_success)
+#define BENCH_COND_INIT(cond) CHECK(cnd_init(&(cond)) == thrd_success)
+#define BENCH_COND_DESTROY(cond) cnd_destroy(&(cond))
+#define BENCH_COND_WAIT(cond, mutex) CHECK(cnd_wait(&(cond), &(mutex)) == thrd_success)
+#define BENCH_COND_BROADCAST(cond) CHECK(cnd_broadcast(&(cond)) == thrd_success)
+#define BENCH_THREAD_FUNC(name, arg) static int name(void *arg)
+#define BENCH_THREAD_RETURN return 0
+#define BENCH_THREAD_CREATE(thread, func, arg) CHECK(thrd_create(&(thread), (func), (arg)) == thrd_success)
+#define BENCH_THREAD_JOIN(thread) CHECK(thrd_join((thread), NULL) == thrd_success)
+#include "bench_impl.h"
+#undef BENCH_IMPL
+#undef BENCH_FN
+#undef bench_mutex_t
+#undef bench_cond_t
+#undef bench_thread_t
+#undef BENCH_MUTEX_INIT
+#undef BENCH_TIMED_MUTEX_INIT
+#undef BENCH_MUTEX_DESTROY
+#undef BENCH_LOCK
+#undef BENCH_UNLOCK
+#undef BENCH_HAS_TIMEDLOCK
+#undef BENCH_TIMEDLOCK
+#undef BENCH_COND_INIT
+#undef BENCH_COND_DESTROY
+#undef BENCH_COND_WAIT
+#undef BENCH_COND_BROADCAST
+#undef BENCH_THREAD_FUNC
+#undef BENCH_THREAD_RETURN
+#undef BENCH_THREAD_CREATE
+#undef BENCH_THREAD_JOIN
+
+#ifndef BENCH_NATIVE_THREADS
+// direct pthread calls as baseline, only needed once so the native build skips them
+#define BENCH_IMPL "pthread"
+#define BENCH_FN(name) name##_pthread
+#define bench_mutex_t pthread_mutex_t
+#define bench_cond_t pthread_cond_t
+#define bench_thread_t pthread_t
+#define BENCH_MUTEX_INIT(mutex) CHECK(!pthread_mutex_init(&(mutex), NULL))
+#define BENCH_TIMED_MUTEX_INIT(mutex) BENCH_MUTEX_INIT(mutex)
+#define BENCH_MUTEX_DESTROY(mutex) CHECK(!pthread_mutex_destroy(&(mutex)))
+#define BENCH_LOCK(mutex) CHECK(!pthread_mutex_lock(&(mutex)))
+#define BENCH_UNLOCK(mutex) CHECK(!pthread_mutex_unlock(&(mutex)))
+#ifdef __APPLE__
+// macOS does not have pthread_mutex_timedlock
+#define BENCH_HAS_TIMEDLOCK 0
+#else
+#define BENCH_HAS_TIMEDLOCK 1
+#define BENCH_TIMEDLOCK(mutex, deadline) CHECK(!pthread_mutex_timedlock(&(mutex), (deadline)))
+#endif
+#define BENCH_COND_INIT(cond) CHECK(!pthread_cond_init(&(cond), NULL))
+#define BENCH_COND_DESTROY(cond) CHECK(!pthread_cond_destroy(&(cond)))
+#define BENCH_COND_WAIT(cond, mutex) CHECK(!pthread_cond_wait(&(cond), &(mutex)))
+#define BENCH_COND_BROADCAST(cond) CHECK(!pthread_cond_broadcast(&(cond)))
+#define BENCH_THREAD_FUNC(name, arg) static void* name(void *arg)
+#define BENCH_THREAD_RETURN return NULL
+#define BENCH_THREAD_CREATE(thread, func, arg) CHECK(!pthread_create(&(thread), NULL, (func), (arg)))
+#define BENCH_THREAD_JOIN(thread) CHECK(!pthread_join((thread), NULL))
+#include "bench_impl.h"
+#endif
+
+static unsigned long long parse_arg(int argc, char **argv, int index, unsigned long long fallback) {
+    if (argc <= index) {
+        return fallback;
+    }
+
+    char *end = NULL;
+    unsigned long long value = strtoull(argv[index], &end, 10);
+    if (!value || *end) {
+        fprintf(stderr, "invalid argument: %s\n", argv[index]);
+        exit(1);
+    }
+
+    return value;
+}
+
+int main(int argc, char **argv) {
+    unsigned int max_threads = (unsigned int) parse_arg(argc, argv, 1, 8);
+    unsigned long long iterations = parse_arg(argc, argv, 2, 1000000);
+    unsigned long long rounds = parse_arg(argc, argv, 3, 1000);
+
+    if (max_threads > BENCH_MAX_THREADS) {
+        max_threads = BENCH_MAX_THREADS;
+    }
+
+    run_benchmarks_c11(max_threads, iterations, rounds);
+
+#ifndef BENCH_NATIVE_THREADS
+    run_benchmarks_pthread(max_threads, iterations, rounds);
+#endif
+
+    return 0;
+}
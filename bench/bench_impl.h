@@ -0,0 +1,231 @@
+// Benchmarks included by bench.c once per implementation; all names are suffixed by BENCH_FN and calls are made by
+// the BENCH_* macros defined for the implementation, so both are compiled from the same code.
+
+static void BENCH_FN(bench_uncontended)(unsigned long long iterations) {
+    bench_mutex_t mutex;
+    BENCH_MUTEX_INIT(mutex);
+
+    unsigned long long start = now_nanos();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        BENCH_LOCK(mutex);
+        BENCH_UNLOCK(mutex);
+    }
+    unsigned long long end = now_nanos();
+
+    report("mtx_uncontended", BENCH_IMPL, 1, iterations, end - start);
+
+    BENCH_MUTEX_DESTROY(mutex);
+}
+
+typedef struct {
+    bench_mutex_t mutex;
+    unsigned long long counter;
+
+    // all threads start together once the main thread also counted itself
+    atomic_uint started;
+    unsigned int num_threads;
+    unsigned long long iterations_per_thread;
+} BENCH_FN(contended_t);
+
+BENCH_THREAD_FUNC(BENCH_FN(contended_thread), arg) {
+    BENCH_FN(contended_t) *state = arg;
+
+    atomic_fetch_add_explicit(&state->started, 1, memory_order_acq_rel);
+    wait_for(&state->started, state->num_threads + 1);
+
+    for (unsigned long long i = 0; i < state->iterations_per_thread; i++) {
+        BENCH_LOCK(state->mutex);
+        state->counter++;
+        BENCH_UNLOCK(state->mutex);
+    }
+
+    BENCH_THREAD_RETURN;
+}
+
+static void BENCH_FN(bench_contended)(unsigned int num_threads, unsigned long long iterations) {
+    BENCH_FN(contended_t) state = {
+        .counter = 0,
+        .started = 0,
+        .num_threads = num_threads,
+        .iterations_per_thread = iterations / num_threads,
+    };
+    BENCH_MUTEX_INIT(state.mutex);
+
+    bench_thread_t threads[BENCH_MAX_THREADS];
+    for (unsigned int i = 0; i < num_threads; i++) {
+        BENCH_THREAD_CREATE(threads[i], BENCH_FN(contended_thread), &state);
+    }
+
+    wait_for(&state.started, num_threads);
+    unsigned long long start = now_nanos();
+    atomic_fetch_add_explicit(&state.started, 1, memory_order_acq_rel);
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        BENCH_THREAD_JOIN(threads[i]);
+    }
+    unsigned long long end = now_nanos();
+
+    unsigned long long ops = state.iterations_per_thread * num_threads;
+    CHECK(state.counter == ops);
+    report("mtx_contended", BENCH_IMPL, num_threads, ops, end - start);
+
+    BENCH_MUTEX_DESTROY(state.mutex);
+}
+
+#if BENCH_HAS_TIMEDLOCK
+typedef struct {
+    bench_mutex_t mutex;
+    unsigned long long rounds;
+
+    // handshake per round: holder locked the mutex, waiter is about to lock, waiter got and released the mutex
+    atomic_uint held;
+    atomic_uint waiting;
+    atomic_uint done;
+
+    atomic_ullong released_at;
+    unsigned long long latency_total;
+} BENCH_FN(timedlock_t);
+
+BENCH_THREAD_FUNC(BENCH_FN(timedlock_thread), arg) {
+    BENCH_FN(timedlock_t) *state = arg;
+
+    for (unsigned int round = 1; round <= state->rounds; round++) {
+        wait_for(&state->held, round);
+
+        struct timespec deadline = utc_deadline(10);
+        atomic_store_explicit(&state->waiting, round, memory_order_release);
+        BENCH_TIMEDLOCK(state->mutex, &deadline);
+        unsigned long long acquired_at = now_nanos();
+        state->latency_total += acquired_at - atomic_load_explicit(&state->released_at, memory_order_relaxed);
+        BENCH_UNLOCK(state->mutex);
+
+        atomic_store_explicit(&state->done, round, memory_order_release);
+    }
+
+    BENCH_THREAD_RETURN;
+}
+
+static void BENCH_FN(bench_timedlock_wakeup)(unsigned long long rounds) {
+    // time from unlocking to a thread blocked in mtx_timedlock acquiring the mutex
+    BENCH_FN(timedlock_t) state = {
+        .rounds = rounds,
+        .held = 0,
+        .waiting = 0,
+        .done = 0,
+        .released_at = 0,
+        .latency_total = 0,
+    };
+    BENCH_TIMED_MUTEX_INIT(state.mutex);
+
+    bench_thread_t thread;
+    BENCH_THREAD_CREATE(thread, BENCH_FN(timedlock_thread), &state);
+
+    struct timespec hold_time = { .tv_sec = 0, .tv_nsec = BENCH_TIMEDLOCK_HOLD_NANOS };
+    for (unsigned int round = 1; round <= rounds; round++) {
+        BENCH_LOCK(state.mutex);
+        atomic_store_explicit(&state.held, round, memory_order_release);
+        wait_for(&state.waiting, round);
+        nanosleep(&hold_time, NULL);
+        atomic_store_explicit(&state.released_at, now_nanos(), memory_order_relaxed);
+        BENCH_UNLOCK(state.mutex);
+        wait_for(&state.done, round);
+    }
+
+    BENCH_THREAD_JOIN(thread);
+
+    report("mtx_timedlock_wakeup", BENCH_IMPL, 2, rounds, state.latency_total);
+
+    BENCH_MUTEX_DESTROY(state.mutex);
+}
+#endif
+
+typedef struct {
+    bench_mutex_t mutex;
+    bench_cond_t cond;
+    unsigned long long rounds;
+
+    // 1 if it is the other thread's turn
+    unsigned int turn;
+} BENCH_FN(pingpong_t);
+
+BENCH_THREAD_FUNC(BENCH_FN(pingpong_thread), arg) {
+    BENCH_FN(pingpong_t) *state = arg;
+
+    BENCH_LOCK(state->mutex);
+    for (unsigned long long i = 0; i < state->rounds; i++) {
+        while (state->turn != 1) {
+            BENCH_COND_WAIT(state->cond, state->mutex);
+        }
+
+        state->turn = 0;
+        BENCH_COND_BROADCAST(state->cond);
+    }
+    BENCH_UNLOCK(state->mutex);
+
+    BENCH_THREAD_RETURN;
+}
+
+static void BENCH_FN(bench_pingpong)(unsigned long long rounds) {
+    // one op is a full round trip of both threads waking each other
+    BENCH_FN(pingpong_t) state = {
+        .rounds = rounds,
+        .turn = 0,
+    };
+    BENCH_MUTEX_INIT(state.mutex);
+    BENCH_COND_INIT(state.cond);
+
+    bench_thread_t thread;
+    BENCH_THREAD_CREATE(thread, BENCH_FN(pingpong_thread), &state);
+
+    unsigned long long start = now_nanos();
+    BENCH_LOCK(state.mutex);
+    for (unsigned long long i = 0; i < rounds; i++) {
+        state.turn = 1;
+        BENCH_COND_BROADCAST(state.cond);
+
+        while (state.turn != 0) {
+            BENCH_COND_WAIT(state.cond, state.mutex);
+        }
+    }
+    BENCH_UNLOCK(state.mutex);
+    unsigned long long end = now_nanos();
+
+    BENCH_THREAD_JOIN(thread);
+
+    report("cnd_pingpong", BENCH_IMPL, 2, rounds, end - start);
+
+    BENCH_COND_DESTROY(state.cond);
+    BENCH_MUTEX_DESTROY(state.mutex);
+}
+
+BENCH_THREAD_FUNC(BENCH_FN(noop_thread), arg) {
+    (void) arg;
+    BENCH_THREAD_RETURN;
+}
+
+static void BENCH_FN(bench_create_join)(unsigned long long rounds) {
+    unsigned long long start = now_nanos();
+    for (unsigned long long i = 0; i < rounds; i++) {
+        bench_thread_t thread;
+        BENCH_THREAD_CREATE(thread, BENCH_FN(noop_thread), NULL);
+        BENCH_THREAD_JOIN(thread);
+    }
+    unsigned long long end = now_nanos();
+
+    report("thrd_create_join", BENCH_IMPL, 1, rounds, end - start);
+}
+
+static void BENCH_FN(run_benchmarks)(unsigned int max_threads, unsigned long long iterations, unsigned long long rounds) {
+    BENCH_FN(bench_uncontended)(iterations);
+
+    for (unsigned int num_threads = 2; num_threads <= max_threads; num_threads++) {
+        BENCH_FN(bench_contended)(num_threads, iterations);
+    }
+
+#if BENCH_HAS_TIMEDLOCK
+    BENCH_FN(bench_timedlock_wakeup)(rounds);
+#endif
+
+    BENCH_FN(bench_pingpong)(rounds);
+    BENCH_FN(bench_create_join)(rounds);
+}
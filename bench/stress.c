@@ -0,0 +1,486 @@
+/**
+ * Stress harness for the C11 threads compatibility wrapper for the macOS(r)
+ * operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ */
+
+// Drives mtx_t, cnd_t and the timed paths of the wrapper (or native threads.h if BENCH_NATIVE_THREADS is defined) with
+// 1 up to max_threads threads for a fixed time each, see README for how to build. Each result is printed as one JSON
+// object per line to stdout:
+// {"benchmark":..., "impl":..., "threads":..., "qos":..., "ops":..., "nanos":..., "ops_per_second":...,
+//  "p50_nanos":..., "p99_nanos":..., "p999_nanos":..., "max_nanos":..., "fairness":..., "per_thread":[...]}
+// Latencies are the time from starting to acquire (the mutex or a turn/token) until holding it, fairness is the ratio
+// of the fewest to the most acquisitions of any thread (1.0 if all threads got the same share) and per_thread lists
+// the acquisitions of each thread.
+//
+// usage: stress [max_threads [millis [qos]]]
+//   max_threads  highest number of threads, starting at 1 (default 8)
+//   millis       duration of each run (default 1000)
+//   qos          QoS class of all threads, only supported by the wrapper on macOS: unspecified (default), background,
+//                utility, default, user_initiated, user_interactive or mixed (alternating user_interactive and
+//                background, e.g. to see P-cores and E-cores on Apple Silicon compete for the same mutex)
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef BENCH_NATIVE_THREADS
+#include <threads.h>
+#define STRESS_IMPL "native"
+#else
+#include "../threads_macos_compat.h"
+#define STRESS_IMPL "threads_macos_compat"
+#endif
+
+#define STRESS_MAX_THREADS (64)
+#define STRESS_NANOS_PER_SECOND (1000000000ULL)
+
+// deadline of timed calls, they are not expected to time out
+#define STRESS_TIMEOUT_SECONDS (10)
+
+// loop iterations run outside of the mutex between acquisitions, so other threads get a chance to acquire it while
+// the previous owner is not competing
+#define STRESS_OUTSIDE_WORK (100)
+
+// latency histogram: values below STRESS_HISTOGRAM_LINEAR nanos are counted exactly, larger values in
+// 2^STRESS_HISTOGRAM_SUB_BITS buckets per power of 2 (at most 12.5% error)
+#define STRESS_HISTOGRAM_SUB_BITS (3)
+#define STRESS_HISTOGRAM_LINEAR (1 << (STRESS_HISTOGRAM_SUB_BITS + 1))
+#define STRESS_HISTOGRAM_BUCKETS (STRESS_HISTOGRAM_LINEAR + (64 - STRESS_HISTOGRAM_SUB_BITS - 1) * (1 << STRESS_HISTOGRAM_SUB_BITS))
+
+#define STRESS_QOS_MIXED (-1)
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            exit(1); \
+        } \
+    } while (0)
+
+typedef enum {
+    STRESS_MTX_LOCK,
+    STRESS_MTX_TIMEDLOCK,
+    STRESS_MTX_TIMEDLOCK_POLLING,
+    STRESS_CND_BROADCAST,
+    STRESS_CND_SIGNAL,
+    STRESS_NUM_SCENARIOS
+} stress_scenario_t;
+
+static const struct {
+    const char *name;
+    int mutex_type;
+} stress_scenarios[STRESS_NUM_SCENARIOS] = {
+    // plain mutex locked by mtx_lock
+    [STRESS_MTX_LOCK] = {"stress_mtx_lock", mtx_plain},
+
+    // mtx_timed mutex locked by mtx_timedlock
+    [STRESS_MTX_TIMEDLOCK] = {"stress_mtx_timedlock", mtx_timed},
+
+    // plain mutex locked by mtx_timedlock, i.e. the polling fallback of the wrapper
+    [STRESS_MTX_TIMEDLOCK_POLLING] = {"stress_mtx_timedlock_polling", mtx_plain},
+
+    // threads take turns in order, each passing the turn on by cnd_broadcast
+    [STRESS_CND_BROADCAST] = {"stress_cnd_broadcast", mtx_plain},
+
+    // threads pass a limited number of tokens between each other, returning one by cnd_signal
+    [STRESS_CND_SIGNAL] = {"stress_cnd_signal", mtx_plain},
+};
+
+static const struct {
+    const char *name;
+    int qos_class;
+} stress_qos_classes[] = {
+    {"unspecified", 0},
+#ifndef BENCH_NATIVE_THREADS
+    {"background", thrd_qos_background},
+    {"utility", thrd_qos_utility},
+    {"default", thrd_qos_default},
+    {"user_initiated", thrd_qos_user_initiated},
+    {"user_interactive", thrd_qos_user_interactive},
+    {"mixed", STRESS_QOS_MIXED},
+#endif
+};
+
+struct stress_run;
+
+typedef struct {
+    // each thread only writes its own record, aligned so records do not share cache lines
+    _Alignas(128) unsigned long long acquisitions;
+    unsigned long long max_nanos;
+    unsigned long long histogram[STRESS_HISTOGRAM_BUCKETS];
+
+    unsigned int index;
+    struct stress_run *run;
+} stress_thread_t;
+
+typedef struct stress_run {
+    stress_scenario_t scenario;
+    unsigned int num_threads;
+
+    mtx_t mutex;
+    cnd_t cond;
+
+    // guarded by mutex
+    unsigned long long counter;
+    unsigned long long turn;
+    unsigned int tokens;
+    bool stop;
+
+    // all threads start together once the main thread also counted itself; stop_requested is only a hint for threads
+    // not blocked in cnd_wait, stop is authoritative
+    atomic_uint started;
+    atomic_bool stop_requested;
+
+    stress_thread_t threads[STRESS_MAX_THREADS];
+} stress_run_t;
+
+static unsigned long long now_nanos() {
+    struct timespec now = {0};
+    CHECK(!clock_gettime(CLOCK_MONOTONIC, &now));
+
+    return (unsigned long long) now.tv_sec * STRESS_NANOS_PER_SECOND + (unsigned long long) now.tv_nsec;
+}
+
+static struct timespec utc_deadline(unsigned int seconds) {
+    struct timespec deadline = {0};
+    CHECK(timespec_get(&deadline, TIME_UTC));
+    deadline.tv_sec += seconds;
+
+    return deadline;
+}
+
+static void wait_for(atomic_uint *value, unsigned int expected) {
+    // yielding instead of pausing so runs also start on machines with less cores than threads
+    while (atomic_load_explicit(value, memory_order_acquire) != expected) {
+        sched_yield();
+    }
+}
+
+static unsigned int histogram_bucket(unsigned long long nanos) {
+    if (nanos < STRESS_HISTOGRAM_LINEAR) {
+        return (unsigned int) nanos;
+    }
+
+    unsigned int exponent = 0;
+    for (unsigned long long rest = nanos >> 1; rest; rest >>= 1) {
+        exponent++;
+    }
+
+    unsigned int shift = exponent - STRESS_HISTOGRAM_SUB_BITS;
+    unsigned int sub = (unsigned int) (nanos >> shift) & ((1 << STRESS_HISTOGRAM_SUB_BITS) - 1);
+
+    return STRESS_HISTOGRAM_LINEAR + (exponent - STRESS_HISTOGRAM_SUB_BITS - 1) * (1 << STRESS_HISTOGRAM_SUB_BITS) + sub;
+}
+
+static unsigned long long histogram_bucket_max(unsigned int bucket) {
+    // highest value counted by the bucket, so percentiles are never reported lower than measured
+    if (bucket < STRESS_HISTOGRAM_LINEAR) {
+        return bucket;
+    }
+
+    unsigned int offset = bucket - STRESS_HISTOGRAM_LINEAR;
+    unsigned int shift = offset / (1 << STRESS_HISTOGRAM_SUB_BITS) + 1;
+    unsigned long long sub = offset % (1 << STRESS_HISTOGRAM_SUB_BITS);
+    unsigned long long lowest = ((1ULL << STRESS_HISTOGRAM_SUB_BITS) + sub) << shift;
+
+    return lowest + (1ULL << shift) - 1;
+}
+
+static unsigned long long histogram_percentile(const unsigned long long *histogram, unsigned long long total, unsigned int per_mille) {
+    // rank of the sample below which per_mille of all samples are found, rounded up
+    unsigned long long rank = (total * per_mille + 999) / 1000;
+    if (!rank) {
+        rank = 1;
+    }
+
+    unsigned long long seen = 0;
+    for (unsigned int i = 0; i < STRESS_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= rank) {
+            return histogram_bucket_max(i);
+        }
+    }
+
+    return 0;
+}
+
+static void outside_work() {
+    volatile unsigned int sink = 0;
+    for (unsigned int i = 0; i < STRESS_OUTSIDE_WORK; i++) {
+        sink += i;
+    }
+}
+
+static void stress_lock(stress_run_t *run) {
+    if (run->scenario == STRESS_MTX_TIMEDLOCK || run->scenario == STRESS_MTX_TIMEDLOCK_POLLING) {
+        struct timespec deadline = utc_deadline(STRESS_TIMEOUT_SECONDS);
+        CHECK(mtx_timedlock(&run->mutex, &deadline) == thrd_success);
+    } else {
+        CHECK(mtx_lock(&run->mutex) == thrd_success);
+    }
+}
+
+static bool stress_acquire(stress_run_t *run, unsigned int index) {
+    // returns with the mutex held, false if the run has been stopped instead
+    stress_lock(run);
+
+    if (run->scenario == STRESS_CND_BROADCAST) {
+        while (!run->stop && (run->turn % run->num_threads) != index) {
+            CHECK(cnd_wait(&run->cond, &run->mutex) == thrd_success);
+        }
+    } else if (run->scenario == STRESS_CND_SIGNAL) {
+        while (!run->stop && !run->tokens) {
+            CHECK(cnd_wait(&run->cond, &run->mutex) == thrd_success);
+        }
+
+        if (!run->stop) {
+            run->tokens--;
+        }
+    }
+
+    return !run->stop;
+}
+
+static void stress_release(stress_run_t *run) {
+    if (run->scenario == STRESS_CND_BROADCAST) {
+        run->turn++;
+        CHECK(cnd_broadcast(&run->cond) == thrd_success);
+    }
+
+    CHECK(mtx_unlock(&run->mutex) == thrd_success);
+
+    if (run->scenario == STRESS_CND_SIGNAL) {
+        // the token is only returned after working outside of the mutex, so others may need to wait for one
+        outside_work();
+
+        stress_lock(run);
+        run->tokens++;
+        CHECK(cnd_signal(&run->cond) == thrd_success);
+        CHECK(mtx_unlock(&run->mutex) == thrd_success);
+    }
+}
+
+static int stress_thread(void *arg) {
+    stress_thread_t *thread = arg;
+    stress_run_t *run = thread->run;
+
+    atomic_fetch_add_explicit(&run->started, 1, memory_order_acq_rel);
+    wait_for(&run->started, run->num_threads + 1);
+
+    while (!atomic_load_explicit(&run->stop_requested, memory_order_relaxed)) {
+        unsigned long long start = now_nanos();
+        if (!stress_acquire(run, thread->index)) {
+            CHECK(mtx_unlock(&run->mutex) == thrd_success);
+            break;
+        }
+        unsigned long long latency = now_nanos() - start;
+
+        run->counter++;
+        stress_release(run);
+
+        thread->acquisitions++;
+        thread->histogram[histogram_bucket(latency)]++;
+        if (latency > thread->max_nanos) {
+            thread->max_nanos = latency;
+        }
+
+        outside_work();
+    }
+
+    return 0;
+}
+
+static void stress_create(thrd_t *thread, stress_thread_t *arg, int qos_class) {
+#ifdef BENCH_NATIVE_THREADS
+    (void) qos_class;
+    CHECK(thrd_create(thread, stress_thread, arg) == thrd_success);
+#else
+    thrd_attr_t attr = {0};
+    if (qos_class == STRESS_QOS_MIXED) {
+        attr.qos_class = (arg->index % 2) ? thrd_qos_background : thrd_qos_user_interactive;
+    } else {
+        attr.qos_class = qos_class;
+    }
+
+    CHECK(thrd_create_ex(thread, stress_thread, arg, &attr) == thrd_success);
+#endif
+}
+
+static void report(const stress_run_t *run, const char *qos_name, unsigned long long nanos) {
+    static unsigned long long histogram[STRESS_HISTOGRAM_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+
+    unsigned long long ops = 0;
+    unsigned long long max_nanos = 0;
+    unsigned long long min_acquisitions = run->threads[0].acquisitions;
+    unsigned long long max_acquisitions = 0;
+    for (unsigned int i = 0; i < run->num_threads; i++) {
+        const stress_thread_t *thread = &run->threads[i];
+
+        for (unsigned int j = 0; j < STRESS_HISTOGRAM_BUCKETS; j++) {
+            histogram[j] += thread->histogram[j];
+        }
+
+        ops += thread->acquisitions;
+        if (thread->max_nanos > max_nanos) {
+            max_nanos = thread->max_nanos;
+        }
+        if (thread->acquisitions < min_acquisitions) {
+            min_acquisitions = thread->acquisitions;
+        }
+        if (thread->acquisitions > max_acquisitions) {
+            max_acquisitions = thread->acquisitions;
+        }
+    }
+
+    printf("{\"benchmark\":\"%s\",\"impl\":\"%s\",\"threads\":%u,\"qos\":\"%s\",\"ops\":%llu,\"nanos\":%llu,"
+           "\"ops_per_second\":%.0f,\"p50_nanos\":%llu,\"p99_nanos\":%llu,\"p999_nanos\":%llu,\"max_nanos\":%llu,"
+           "\"fairness\":%.3f,\"per_thread\":[",
+           stress_scenarios[run->scenario].name, STRESS_IMPL, run->num_threads, qos_name, ops, nanos,
+           nanos ? ((double) ops * STRESS_NANOS_PER_SECOND / (double) nanos) : 0.0,
+           histogram_percentile(histogram, ops, 500), histogram_percentile(histogram, ops, 990),
+           histogram_percentile(histogram, ops, 999), max_nanos,
+           max_acquisitions ? ((double) min_acquisitions / (double) max_acquisitions) : 0.0);
+
+    for (unsigned int i = 0; i < run->num_threads; i++) {
+        printf("%s%llu", i ? "," : "", run->threads[i].acquisitions);
+    }
+
+    printf("]}\n");
+    fflush(stdout);
+}
+
+static void stress(stress_scenario_t scenario, unsigned int num_threads, unsigned long long millis, int qos_class, const char *qos_name) {
+    // too large for the stack
+    stress_run_t *run = aligned_alloc(_Alignof(stress_run_t), sizeof(stress_run_t));
+    CHECK(run);
+    memset(run, 0, sizeof(stress_run_t));
+
+    run->scenario = scenario;
+    run->num_threads = num_threads;
+    run->tokens = (num_threads > 1) ? num_threads / 2 : 1;
+    CHECK(mtx_init(&run->mutex, stress_scenarios[scenario].mutex_type) == thrd_success);
+    CHECK(cnd_init(&run->cond) == thrd_success);
+
+    thrd_t threads[STRESS_MAX_THREADS];
+    for (unsigned int i = 0; i < num_threads; i++) {
+        run->threads[i].index = i;
+        run->threads[i].run = run;
+        stress_create(&threads[i], &run->threads[i], qos_class);
+    }
+
+    wait_for(&run->started, num_threads);
+    unsigned long long start = now_nanos();
+    atomic_fetch_add_explicit(&run->started, 1, memory_order_acq_rel);
+
+    struct timespec duration = {
+        .tv_sec = millis / 1000,
+        .tv_nsec = (millis % 1000) * 1000000,
+    };
+    while (thrd_sleep(&duration, &duration) == -1) {
+        // interrupted, continue with the remaining time
+    }
+
+    // threads blocked in cnd_wait need to be woken to notice
+    atomic_store_explicit(&run->stop_requested, true, memory_order_relaxed);
+    CHECK(mtx_lock(&run->mutex) == thrd_success);
+    run->stop = true;
+    CHECK(cnd_broadcast(&run->cond) == thrd_success);
+    CHECK(mtx_unlock(&run->mutex) == thrd_success);
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        CHECK(thrd_join(threads[i], NULL) == thrd_success);
+    }
+    unsigned long long end = now_nanos();
+
+    unsigned long long ops = 0;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        ops += run->threads[i].acquisitions;
+    }
+    CHECK(run->counter == ops);
+
+    report(run, qos_name, end - start);
+
+    cnd_destroy(&run->cond);
+    mtx_destroy(&run->mutex);
+    free(run);
+}
+
+static unsigned long long parse_arg(int argc, char **argv, int index, unsigned long long fallback) {
+    if (argc <= index) {
+        return fallback;
+    }
+
+    char *end = NULL;
+    unsigned long long value = strtoull(argv[index], &end, 10);
+    if (!value || *end) {
+        fprintf(stderr, "invalid argument: %s\n", argv[index]);
+        exit(1);
+    }
+
+    return value;
+}
+
+int main(int argc, char **argv) {
+    unsigned int max_threads = (unsigned int) parse_arg(argc, argv, 1, 8);
+    unsigned long long millis = parse_arg(argc, argv, 2, 1000);
+    const char *qos_name = (argc > 3) ? argv[3] : "unspecified";
+
+    if (max_threads > STRESS_MAX_THREADS) {
+        max_threads = STRESS_MAX_THREADS;
+    }
+
+    int qos_class = 0;
+    bool found = false;
+    for (size_t i = 0; i < sizeof(stress_qos_classes) / sizeof(stress_qos_classes[0]); i++) {
+        if (!strcmp(qos_name, stress_qos_classes[i].name)) {
+            qos_class = stress_qos_classes[i].qos_class;
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "unsupported QoS class: %s\n", qos_name);
+        exit(1);
+    }
+
+    for (int scenario = 0; scenario < STRESS_NUM_SCENARIOS; scenario++) {
+        for (unsigned int num_threads = 1; num_threads <= max_threads; num_threads++) {
+            stress((stress_scenario_t) scenario, num_threads, millis, qos_class, qos_name);
+        }
+    }
+
+    return 0;
+}
@@ -43,325 +43,3482 @@
  * project.
  */
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <sched.h>
+#include <unistd.h>
 
+#ifdef __APPLE__
+#include <pthread/qos.h>
+#endif
+
+#if defined(THREADS_COMPAT_TRACING) && defined(__APPLE__)
+#include <os/log.h>
+#include <os/signpost.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#if defined(__linux__) && !defined(THREADS_COMPAT_ADDR_WAIT_PARKING_LOT)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#define THREADS_COMPAT_USE_FUTEX
+#elif defined(__APPLE__) && !defined(THREADS_COMPAT_ADDR_WAIT_PARKING_LOT) && defined(__has_include)
+#if __has_include(<os/os_sync_wait_on_address.h>)
+// only available since macOS 14.4, older systems fall back to the parking lot at runtime
+#include <os/clock.h>
+#include <os/os_sync_wait_on_address.h>
+#define THREADS_COMPAT_USE_OS_SYNC
+#endif
+#endif
+
+// the out-of-line definitions are needed here, inline mode only applies to the including application
+#undef THREADS_MACOS_COMPAT_INLINE
 #include "threads_macos_compat.h"
 
-#ifndef THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS
-#define THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS 1000 /* default to 1ms */
+#ifndef THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS
+#define THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS 1000000 /* default to 1ms */
+#endif
+
+#ifndef THREADS_COMPAT_THREAD_RECORDS
+#define THREADS_COMPAT_THREAD_RECORDS 64
+#endif
+
+#ifndef THREADS_COMPAT_THREAD_CACHE_SIZE
+#define THREADS_COMPAT_THREAD_CACHE_SIZE 16
+#endif
+
+#ifndef THREADS_COMPAT_THREAD_CACHE_IDLE_MILLIS
+#define THREADS_COMPAT_THREAD_CACHE_IDLE_MILLIS 10000
+#endif
+
+#ifndef THREADS_COMPAT_PARKING_LOT_BUCKETS
+#define THREADS_COMPAT_PARKING_LOT_BUCKETS 256 /* must be a power of 2 */
+#endif
+
+#ifndef THREADS_COMPAT_ERROR_BUFFER_SIZE
+#define THREADS_COMPAT_ERROR_BUFFER_SIZE 64 /* must be a power of 2 */
+#endif
+
+#ifndef THREADS_COMPAT_SLEEP_SPIN_NANOS
+#define THREADS_COMPAT_SLEEP_SPIN_NANOS 0 /* only used with THREADS_COMPAT_PRECISE_SLEEP, default to not spin */
+#endif
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+#define THREADS_COMPAT_NANOS_PER_SECOND (1000000000)
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+#define IS_UNFAIR_MUTEX(mutex) (((mutex)->type & ~mtx_prio_inherit) == mtx_plain)
+#else
+#define IS_UNFAIR_MUTEX(mutex) (false)
+#endif
+
+// mtx_timed mutexes keep their own lock state unless priority inheritance requires waiters to block on the mutex itself
+#define IS_COND_TIMED_MUTEX(mutex) (((mutex)->type & (mtx_timed | mtx_prio_inherit)) == mtx_timed)
+
+#if defined(THREADS_COMPAT_TRACING) && (defined(THREADS_COMPAT_TRACE_CHROME) || !defined(__APPLE__))
+#define THREADS_COMPAT_USE_TRACE_BUFFER
+#endif
+
+#ifndef THREADS_COMPAT_TRACE_BUFFER_SIZE
+#define THREADS_COMPAT_TRACE_BUFFER_SIZE 65536 /* events */
+#endif
+
+#ifndef THREADS_COMPAT_TRACE_SUBSYSTEM
+#define THREADS_COMPAT_TRACE_SUBSYSTEM "threads_macos_compat"
+#endif
+
+// trace_begin declares span to be passed to trace_end when the traced call is done; name must be a string literal
+#if !defined(THREADS_COMPAT_TRACING)
+#define trace_begin(span, name, object) ((void) 0)
+#define trace_end(span, name) ((void) 0)
+#elif defined(THREADS_COMPAT_USE_TRACE_BUFFER)
+typedef struct {
+    const char *name;
+    const void *object;
+    unsigned long long start_nanos;
+} trace_span_t;
+
+static unsigned long long trace_now();
+static void trace_record(const trace_span_t *span);
+
+#define trace_begin(span, name, object) trace_span_t span = { (name), (object), trace_now() }
+#define trace_end(span, name) trace_record(&(span))
+#else
+static os_log_t trace_log();
+
+#define trace_begin(span, name, object) \
+    os_signpost_id_t span = os_signpost_id_generate(trace_log()); \
+    os_signpost_interval_begin(trace_log(), span, name, "%p", (const void*) (object))
+#define trace_end(span, name) os_signpost_interval_end(trace_log(), span, name)
+#endif
+static inline bool timespec_is_greater_than(const struct timespec *a, const struct timespec *b) {
+    if (a->tv_sec > b->tv_sec) {
+        return true;
+    }
+
+    if (a->tv_sec < b->tv_sec) {
+        return false;
+    }
+
+    return a->tv_nsec > b->tv_nsec;
+}
+
+static int init_monotonic_cond(pthread_cond_t *cond) {
+#ifdef __APPLE__
+    // macOS waits relative to the monotonic clock instead, see cond_wait_until
+    return pthread_cond_init(cond, NULL);
+#else
+    pthread_condattr_t attr;
+    int err = pthread_condattr_init(&attr);
+    if (err) {
+        return err;
+    }
+
+    err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (!err) {
+        err = pthread_cond_init(cond, &attr);
+    }
+
+    int fin_err = pthread_condattr_destroy(&attr);
+    if (fin_err) {
+        report_error("pthread_condattr_destroy", fin_err);
+    }
+
+    return err;
+#endif
+}
+
+#ifdef THREADS_COMPAT_USE_LAZY_COND
+// condition variables of statically initialized objects are only initialized for CLOCK_MONOTONIC on first use; all
+// of those initializations are serialized by one mutex as they happen at most once per object
+static pthread_mutex_t lazy_cond_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int lazy_cond_init_slow(pthread_cond_t *cond, atomic_bool *initialized) {
+    int err = pthread_mutex_lock(&lazy_cond_mutex);
+    if (err) {
+        return err;
+    }
+
+    if (!atomic_load_explicit(initialized, memory_order_relaxed)) {
+        err = init_monotonic_cond(cond);
+        if (!err) {
+            atomic_store_explicit(initialized, true, memory_order_release);
+        }
+    }
+
+    int fin_err = pthread_mutex_unlock(&lazy_cond_mutex);
+    if (fin_err) {
+        report_error("lazy condition pthread_mutex_unlock", fin_err);
+    }
+
+    return err;
+}
+
+static inline int lazy_cond_init(pthread_cond_t *cond, atomic_bool *initialized) {
+    return atomic_load_explicit(initialized, memory_order_acquire) ? 0 : lazy_cond_init_slow(cond, initialized);
+}
+
+#define LAZY_COND_INIT(cond, initialized) lazy_cond_init((cond), (initialized))
+#define LAZY_COND_IS_INITIALIZED(initialized) atomic_load_explicit((initialized), memory_order_acquire)
+#define LAZY_COND_SET_INITIALIZED(initialized) atomic_init((initialized), true)
+#else
+// static initializers already initialize condition variables
+#define LAZY_COND_INIT(cond, initialized) (0)
+#define LAZY_COND_IS_INITIALIZED(initialized) (true)
+#define LAZY_COND_SET_INITIALIZED(initialized) ((void) 0)
+#endif
+
+// time_t is a signed integer type on all supported systems
+#define THREADS_COMPAT_TIME_T_MAX ((time_t) ((((uintmax_t) 1) << (sizeof(time_t) * CHAR_BIT - 1)) - 1))
+#define THREADS_COMPAT_TIME_T_MIN (-THREADS_COMPAT_TIME_T_MAX - 1)
+
+static inline void timespec_saturate(struct timespec *a, bool max) {
+    a->tv_sec = max ? THREADS_COMPAT_TIME_T_MAX : THREADS_COMPAT_TIME_T_MIN;
+    a->tv_nsec = max ? THREADS_COMPAT_NANOS_PER_SECOND - 1 : 0;
+}
+
+// Time points far in the future (e.g. tv_sec close to its maximum to wait "forever") must not wrap around to a deadline
+// in the past, so additions and subtractions saturate at the limits of time_t instead of overflowing.
+static inline void timespec_add(struct timespec *a, const struct timespec *b) {
+    if ((b->tv_sec > 0) && (a->tv_sec > THREADS_COMPAT_TIME_T_MAX - b->tv_sec)) {
+        timespec_saturate(a, true);
+        return;
+    }
+
+    if ((b->tv_sec < 0) && (a->tv_sec < THREADS_COMPAT_TIME_T_MIN - b->tv_sec)) {
+        timespec_saturate(a, false);
+        return;
+    }
+
+    a->tv_sec += b->tv_sec;
+    a->tv_nsec += b->tv_nsec;
+    if (a->tv_nsec >= THREADS_COMPAT_NANOS_PER_SECOND) {
+        if (a->tv_sec == THREADS_COMPAT_TIME_T_MAX) {
+            timespec_saturate(a, true);
+            return;
+        }
+
+        a->tv_sec++;
+        a->tv_nsec -= THREADS_COMPAT_NANOS_PER_SECOND;
+    }
+}
+
+static inline void timespec_subtract(struct timespec *a, const struct timespec *b) {
+    if ((b->tv_sec > 0) && (a->tv_sec < THREADS_COMPAT_TIME_T_MIN + b->tv_sec)) {
+        timespec_saturate(a, false);
+        return;
+    }
+
+    if ((b->tv_sec < 0) && (a->tv_sec > THREADS_COMPAT_TIME_T_MAX + b->tv_sec)) {
+        timespec_saturate(a, true);
+        return;
+    }
+
+    a->tv_sec -= b->tv_sec;
+    a->tv_nsec -= b->tv_nsec;
+    if (a->tv_nsec < 0) {
+        if (a->tv_sec == THREADS_COMPAT_TIME_T_MIN) {
+            timespec_saturate(a, false);
+            return;
+        }
+
+        a->tv_sec--;
+        a->tv_nsec += THREADS_COMPAT_NANOS_PER_SECOND;
+    }
+}
+
+static inline uint64_t timespec_to_nanos(const struct timespec *a) {
+    // negative times clamp to 0, times beyond the range of 64-bit nanoseconds saturate
+    if (a->tv_sec < 0) {
+        return 0;
+    }
+
+    if ((uint64_t) a->tv_sec >= UINT64_MAX / THREADS_COMPAT_NANOS_PER_SECOND) {
+        return UINT64_MAX;
+    }
+
+    return (uint64_t) a->tv_sec * THREADS_COMPAT_NANOS_PER_SECOND + (uint64_t) a->tv_nsec;
+}
+
+// All timed operations wait for deadlines of a single monotonic clock: CLOCK_MONOTONIC or, on macOS, the cheaper
+// mach_absolute_time (which does not advance while the system is asleep). Waits which only take relative timeouts
+// calculate them from the same clock, so deadlines can be compared and passed on without further conversion. Time
+// points given by callers (TIME_UTC, or CLOCK_MONOTONIC which does advance while asleep on macOS) are converted once.
+#ifdef __APPLE__
+// numer in the upper, denom in the lower 32 bits of the timebase, 0 until first needed
+static atomic_ullong clock_timebase = 0;
+
+static inline void clock_get_timebase(uint64_t *numer, uint64_t *denom) {
+    unsigned long long timebase = atomic_load_explicit(&clock_timebase, memory_order_relaxed);
+    if (!timebase) {
+        // the timebase is constant, so racing threads just store the same value
+        mach_timebase_info_data_t info = {0};
+        mach_timebase_info(&info);
+        timebase = ((unsigned long long) info.numer << 32) | info.denom;
+        atomic_store_explicit(&clock_timebase, timebase, memory_order_relaxed);
+    }
+
+    *numer = timebase >> 32;
+    *denom = timebase & UINT32_MAX;
+}
+
+static inline uint64_t clock_scale(uint64_t value, uint64_t mul, uint64_t div) {
+    // value * mul / div for 32-bit mul and div without overflowing the intermediate product; results which do not fit
+    // saturate, so huge deadlines stay huge instead of wrapping around to short timeouts
+    uint64_t quotient = value / div;
+    if (quotient > UINT64_MAX / mul) {
+        return UINT64_MAX;
+    }
+
+    uint64_t high = quotient * mul;
+    uint64_t low = (value % div) * mul / div;
+
+    return (low > UINT64_MAX - high) ? UINT64_MAX : high + low;
+}
+
+static inline uint64_t clock_ticks_from_nanos(uint64_t nanos) {
+    // mach_absolute_time counts ticks of the timebase (nanoseconds on Intel, 125/3 nanoseconds on Apple Silicon)
+    uint64_t numer = 0;
+    uint64_t denom = 0;
+    clock_get_timebase(&numer, &denom);
+
+    return clock_scale(nanos, denom, numer);
+}
+
+static inline uint64_t clock_nanos_from_ticks(uint64_t ticks) {
+    uint64_t numer = 0;
+    uint64_t denom = 0;
+    clock_get_timebase(&numer, &denom);
+
+    return clock_scale(ticks, numer, denom);
+}
+
+static inline uint64_t clock_now_nanos() {
+    return clock_nanos_from_ticks(mach_absolute_time());
+}
+#else
+static inline uint64_t clock_now_nanos() {
+    // cannot fail for a supported clock
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * THREADS_COMPAT_NANOS_PER_SECOND + (uint64_t) now.tv_nsec;
+}
+#endif
+
+static inline void clock_now(struct timespec *now) {
+    uint64_t nanos = clock_now_nanos();
+    now->tv_sec = nanos / THREADS_COMPAT_NANOS_PER_SECOND;
+    now->tv_nsec = nanos % THREADS_COMPAT_NANOS_PER_SECOND;
+}
+
+static void deadline_from_time_point(const struct timespec *time_point, const struct timespec *now_of_time_point,
+                                     struct timespec *deadline) {
+    // moves the time remaining until time_point (based on another clock) to the shared clock
+    clock_now(deadline);
+
+    struct timespec remaining = *time_point;
+    timespec_subtract(&remaining, now_of_time_point);
+    timespec_add(deadline, &remaining);
+}
+
+static int monotonic_deadline_from_utc(const struct timespec *time_point, struct timespec *deadline) {
+    // converted only once per call so wall-clock adjustments (e.g. NTP) while waiting do not affect the timeout
+    struct timespec now_utc = {0};
+    if (!timespec_get(&now_utc, TIME_UTC)) {
+        report_error("timespec_get failed", 0);
+        return thrd_error;
+    }
+
+    deadline_from_time_point(time_point, &now_utc, deadline);
+
+    return thrd_success;
+}
+
+static int monotonic_deadline_from_clock_monotonic(const struct timespec *time_point, struct timespec *deadline) {
+#ifdef __APPLE__
+    // CLOCK_MONOTONIC keeps counting while the system is asleep but mach_absolute_time does not, so the clocks drift
+    // apart by the total time spent asleep; the time point is converted once like those based on TIME_UTC
+    struct timespec now_monotonic = {0};
+    if (clock_gettime(CLOCK_MONOTONIC, &now_monotonic)) {
+        report_error("clock_gettime(CLOCK_MONOTONIC)", errno);
+        return thrd_error;
+    }
+
+    deadline_from_time_point(time_point, &now_monotonic, deadline);
+#else
+    // already based on the shared clock
+    *deadline = *time_point;
+#endif
+
+    return thrd_success;
+}
+
+#ifdef __APPLE__
+// relative timeouts are added to the current time in nanoseconds by the kernel, so they are limited to stay clear of
+// overflows; waits ending early due to the limit look like spurious wake-ups to callers, which check again anyway
+#define THREADS_COMPAT_MAX_RELATIVE_WAIT_SECONDS ((time_t) INT32_MAX)
+
+static bool remaining_until(const struct timespec *deadline, struct timespec *remaining) {
+    // returns false if the deadline has already passed
+    struct timespec now = {0};
+    clock_now(&now);
+    if (!timespec_is_greater_than(deadline, &now)) {
+        return false;
+    }
+
+    *remaining = *deadline;
+    timespec_subtract(remaining, &now);
+
+    if (remaining->tv_sec >= THREADS_COMPAT_MAX_RELATIVE_WAIT_SECONDS) {
+        remaining->tv_sec = THREADS_COMPAT_MAX_RELATIVE_WAIT_SECONDS;
+        remaining->tv_nsec = 0;
+    }
+
+    return true;
+}
+#endif
+
+static int cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline) {
+    // deadline is based on the monotonic clock, NULL waits indefinitely
+    if (!deadline) {
+        return pthread_cond_wait(cond, mutex);
+    }
+
+#ifdef __APPLE__
+    struct timespec remaining = {0};
+    if (!remaining_until(deadline, &remaining)) {
+        return ETIMEDOUT;
+    }
+
+    return pthread_cond_timedwait_relative_np(cond, mutex, &remaining);
+#else
+    return pthread_cond_timedwait(cond, mutex, deadline);
+#endif
+}
+
+_Static_assert(sizeof(atomic_uint) == sizeof(unsigned int), "address waiting requires lock-free 32-bit atomics");
+
+#ifdef THREADS_COMPAT_USE_FUTEX
+static int futex_wait(atomic_uint *address, unsigned int expected, const struct timespec *deadline) {
+    // FUTEX_WAIT_BITSET takes an absolute deadline based on CLOCK_MONOTONIC; deadlines before the start of the clock
+    // (time points far in the past) are rejected as invalid by the kernel but have passed anyway
+    if (deadline && (deadline->tv_sec < 0)) {
+        return thrd_timedout;
+    }
+
+    long res = syscall(SYS_futex, address, FUTEX_WAIT_BITSET_PRIVATE, expected, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+    if (!res || errno == EAGAIN || errno == EINTR) {
+        return thrd_success;
+    }
+
+    if (errno == ETIMEDOUT) {
+        return thrd_timedout;
+    }
+
+    report_error("futex FUTEX_WAIT_BITSET", errno);
+    return thrd_error;
+}
+
+static int futex_wake(atomic_uint *address, int num_threads) {
+    if (syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, num_threads, NULL, NULL, 0) < 0) {
+        report_error("futex FUTEX_WAKE", errno);
+        return thrd_error;
+    }
+
+    return thrd_success;
+}
+#endif
+
+#ifdef THREADS_COMPAT_USE_OS_SYNC
+#define OS_SYNC_AVAILABILITY __attribute__((availability(macos, introduced=14.4)))
+
+OS_SYNC_AVAILABILITY static int os_sync_wait(atomic_uint *address, unsigned int expected, const struct timespec *deadline) {
+    int res = 0;
+
+    if (!deadline) {
+        res = os_sync_wait_on_address(address, expected, sizeof(*address), OS_SYNC_WAIT_ON_ADDRESS_NONE);
+    } else {
+        // only relative timeouts can be given for the monotonic clock
+        struct timespec remaining = {0};
+        if (!remaining_until(deadline, &remaining)) {
+            return thrd_timedout;
+        }
+
+        uint64_t timeout_nanos = timespec_to_nanos(&remaining);
+        res = os_sync_wait_on_address_with_timeout(address, expected, sizeof(*address), OS_SYNC_WAIT_ON_ADDRESS_NONE, OS_CLOCK_MACH_ABSOLUTE_TIME, timeout_nanos);
+    }
+
+    if (res >= 0 || errno == EINTR) {
+        return thrd_success;
+    }
+
+    if (errno == ETIMEDOUT) {
+        return thrd_timedout;
+    }
+
+    report_error("os_sync_wait_on_address", errno);
+    return thrd_error;
+}
+
+OS_SYNC_AVAILABILITY static int os_sync_wake(atomic_uint *address, bool all) {
+    int res = all ? os_sync_wake_by_address_all(address, sizeof(*address), OS_SYNC_WAKE_BY_ADDRESS_NONE)
+                  : os_sync_wake_by_address_any(address, sizeof(*address), OS_SYNC_WAKE_BY_ADDRESS_NONE);
+
+    // ENOENT just means that nobody was waiting
+    if (res && errno != ENOENT) {
+        report_error(all ? "os_sync_wake_by_address_all" : "os_sync_wake_by_address_any", errno);
+        return thrd_error;
+    }
+
+    return thrd_success;
+}
+#endif
+
+#ifndef THREADS_COMPAT_USE_FUTEX
+// fallback if the system cannot wait on addresses: threads park on the condition variable of a bucket chosen by the
+// address they wait on; buckets are shared, so waking always needs to wake all threads parked on a bucket
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int waiters;
+} parking_bucket_t;
+
+static parking_bucket_t parking_lot[THREADS_COMPAT_PARKING_LOT_BUCKETS];
+static pthread_once_t parking_lot_once = PTHREAD_ONCE_INIT;
+static bool parking_lot_ready = false;
+
+static void parking_lot_init() {
+    for (unsigned int i = 0; i < THREADS_COMPAT_PARKING_LOT_BUCKETS; i++) {
+        int err = pthread_mutex_init(&parking_lot[i].mutex, NULL);
+        if (err) {
+            report_error("parking lot pthread_mutex_init", err);
+            return;
+        }
+
+        err = init_monotonic_cond(&parking_lot[i].cond);
+        if (err) {
+            report_error("parking lot pthread_cond_init", err);
+            return;
+        }
+    }
+
+    parking_lot_ready = true;
+}
+
+static parking_bucket_t* parking_bucket(const atomic_uint *address) {
+    pthread_once(&parking_lot_once, parking_lot_init);
+    if (!parking_lot_ready) {
+        return NULL;
+    }
+
+    uint64_t hash = (uint64_t) (uintptr_t) address * UINT64_C(0x9E3779B97F4A7C15);
+    return &parking_lot[(hash >> 32) & (THREADS_COMPAT_PARKING_LOT_BUCKETS - 1)];
+}
+
+static int parking_lot_wait(atomic_uint *address, unsigned int expected, const struct timespec *deadline) {
+    parking_bucket_t *bucket = parking_bucket(address);
+    if (!bucket) {
+        return thrd_error;
+    }
+
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&bucket->mutex);
+    if (err) {
+        report_error("parking lot pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    // wakers change the value before locking the bucket, so checking it while holding the bucket cannot miss a wake
+    if (atomic_load_explicit(address, memory_order_relaxed) == expected) {
+        bucket->waiters++;
+        err = cond_wait_until(&bucket->cond, &bucket->mutex, deadline);
+        bucket->waiters--;
+
+        if (err == ETIMEDOUT) {
+            res = thrd_timedout;
+        } else if (err) {
+            report_error("parking lot pthread_cond_(timed)wait", err);
+            res = thrd_error;
+        }
+    }
+
+    err = pthread_mutex_unlock(&bucket->mutex);
+    if (err) {
+        report_error("parking lot pthread_mutex_unlock", err);
+        return thrd_error;
+    }
+
+    return res;
+}
+
+static int parking_lot_wake(atomic_uint *address) {
+    parking_bucket_t *bucket = parking_bucket(address);
+    if (!bucket) {
+        return thrd_error;
+    }
+
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&bucket->mutex);
+    if (err) {
+        report_error("parking lot pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    if (bucket->waiters) {
+        err = pthread_cond_broadcast(&bucket->cond);
+        if (err) {
+            report_error("parking lot pthread_cond_broadcast", err);
+            res = thrd_error;
+        }
+    }
+
+    err = pthread_mutex_unlock(&bucket->mutex);
+    if (err) {
+        report_error("parking lot pthread_mutex_unlock", err);
+        return thrd_error;
+    }
+
+    return res;
+}
+#endif
+
+static int addr_wait_until(atomic_uint *address, unsigned int expected, const struct timespec *deadline) {
+    // deadline is based on the monotonic clock, NULL waits indefinitely
+#if defined(THREADS_COMPAT_USE_FUTEX)
+    return futex_wait(address, expected, deadline);
+#elif defined(THREADS_COMPAT_USE_OS_SYNC)
+    if (__builtin_available(macOS 14.4, *)) {
+        return os_sync_wait(address, expected, deadline);
+    }
+
+    return parking_lot_wait(address, expected, deadline);
+#else
+    return parking_lot_wait(address, expected, deadline);
+#endif
+}
+
+static int addr_wake_some(atomic_uint *address, bool all) {
+#if defined(THREADS_COMPAT_USE_FUTEX)
+    return futex_wake(address, all ? INT_MAX : 1);
+#elif defined(THREADS_COMPAT_USE_OS_SYNC)
+    if (__builtin_available(macOS 14.4, *)) {
+        return os_sync_wake(address, all);
+    }
+
+    return parking_lot_wake(address);
+#else
+    (void) all;
+    return parking_lot_wake(address);
+#endif
+}
+
+int addr_wait(atomic_uint *address, unsigned int expected) {
+    return addr_wait_until(address, expected, NULL);
+}
+
+int addr_timedwait(atomic_uint *address, unsigned int expected, const struct timespec *time_point) {
+    struct timespec deadline = {0};
+    if (monotonic_deadline_from_utc(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    return addr_wait_until(address, expected, &deadline);
+}
+
+int addr_wake(atomic_uint *address) {
+    return addr_wake_some(address, false);
+}
+
+int addr_wake_all(atomic_uint *address) {
+    return addr_wake_some(address, true);
+}
+
+
+static bool is_supported_mtx_type(int type) {
+    // mtx_prio_inherit can be combined with all standard types
+    type &= ~mtx_prio_inherit;
+    return type == mtx_plain || type == (mtx_plain | mtx_recursive) || type == mtx_timed || type == (mtx_timed | mtx_recursive);
+}
+
+#ifndef THREADS_COMPAT_ADDR_WAIT
+// Lock state of mtx_timed mutexes. Only timed mutexes need it, so it is allocated separately and takes the place of
+// the pthread_mutex_t in mtx_t; all other mutexes just add type and spinning options to their pthread_mutex_t.
+typedef struct threads_compat_mtx_timed {
+    // guards the lock state, waiters block on released while the lock is held
+    pthread_mutex_t guard;
+    pthread_cond_t released;
+    pthread_t owner;
+    unsigned int lock_count;
+    unsigned int waiters;
+} timed_mtx_state_t;
+
+static int timed_mtx_state_create(timed_mtx_state_t **state) {
+    timed_mtx_state_t *created = malloc(sizeof(timed_mtx_state_t));
+    if (!created) {
+        return ENOMEM;
+    }
+
+    int err = pthread_mutex_init(&created->guard, NULL);
+    if (err) {
+        free(created);
+        return err;
+    }
+
+    err = init_monotonic_cond(&created->released);
+    if (err) {
+        int fin_err = pthread_mutex_destroy(&created->guard);
+        if (fin_err) {
+            report_error("pthread_mutex_destroy", fin_err);
+        }
+
+        free(created);
+        return err;
+    }
+
+    created->lock_count = 0;
+    created->waiters = 0;
+
+    *state = created;
+    return 0;
+}
+
+static void timed_mtx_state_free(timed_mtx_state_t *state) {
+    int err = pthread_mutex_destroy(&state->guard);
+    if (err) {
+        report_error("pthread_mutex_destroy", err);
+    }
+
+    err = pthread_cond_destroy(&state->released);
+    if (err) {
+        report_error("pthread_cond_destroy", err);
+    }
+
+    free(state);
+}
+
+static timed_mtx_state_t* timed_mtx_state(mtx_t *mutex) {
+    // statically initialized mutexes only allocate their lock state on first use; if threads race to do so, all but
+    // the first one discard their allocation
+    timed_mtx_state_t *state = atomic_load_explicit(&mutex->timed, memory_order_acquire);
+    if (state) {
+        return state;
+    }
+
+    timed_mtx_state_t *created = NULL;
+    int err = timed_mtx_state_create(&created);
+    if (err) {
+        report_error("timed mutex state", err);
+        return NULL;
+    }
+
+    if (!atomic_compare_exchange_strong_explicit(&mutex->timed, &state, created, memory_order_acq_rel, memory_order_acquire)) {
+        timed_mtx_state_free(created);
+        return state;
+    }
+
+    return created;
+}
+
+static int timed_mtx_init(mtx_t *mutex) {
+    // mtx_timed mutexes are implemented by a condition variable guarded by a plain mutex, so waiters can block with
+    // a timeout (macOS does not support pthread_mutex_timedlock)
+    timed_mtx_state_t *state = NULL;
+    int err = timed_mtx_state_create(&state);
+    if (err) {
+        report_error("timed mutex state", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+
+    atomic_init(&mutex->timed, state);
+
+    return thrd_success;
+}
+
+static int raw_mtx_init(mtx_t *mutex, int type) {
+    int err = 0;
+    int fin_err = 0;
+
+    if (!is_supported_mtx_type(type)) {
+        report_error("mtx_init unsupported type requested", EINVAL);
+        return thrd_error;
+    }
+
+    mutex->type = type;
+    mutex->spin_count = THREADS_COMPAT_MTX_SPIN_COUNT;
+    mutex->spin_backoff_max = THREADS_COMPAT_MTX_SPIN_BACKOFF_MAX;
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        return timed_mtx_init(mutex);
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        mutex->unfair = OS_UNFAIR_LOCK_INIT;
+        return thrd_success;
+    }
+#endif
+
+    pthread_mutexattr_t attr = {0};
+    err = pthread_mutexattr_init(&attr);
+    if (err) {
+        report_error("pthread_mutexattr_init", err);
+        return thrd_error;
+    }
+    
+    if (type & mtx_recursive) {
+        err = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        if (err) {
+            report_error("pthread_mutexattr_settype PTHREAD_MUTEX_RECURSIVE", err);
+            goto end;
+        }
+    } else if (type & mtx_timed) {
+        // timed mutexes detect deadlocks, like those keeping their own lock state do
+        err = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+        if (err) {
+            report_error("pthread_mutexattr_settype PTHREAD_MUTEX_ERRORCHECK", err);
+            goto end;
+        }
+    }
+
+    if (type & mtx_prio_inherit) {
+        err = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+        if (err) {
+            report_error("pthread_mutexattr_setprotocol PTHREAD_PRIO_INHERIT", err);
+            goto end;
+        }
+    }
+    
+    err = pthread_mutex_init(&mutex->mutex, &attr);
+    if (err) {
+        report_error("pthread_mutex_init", err);
+    }
+
+end:
+    fin_err = pthread_mutexattr_destroy(&attr);
+    if (fin_err) {
+        report_error("pthread_mutexattr_destroy", fin_err);
+    }
+    
+    return err ? thrd_error : thrd_success;
+}
+
+static void raw_mtx_destroy(mtx_t *mutex) {
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        // os_unfair_lock does not need to be destroyed
+        return;
+    }
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        timed_mtx_state_t *state = atomic_load_explicit(&mutex->timed, memory_order_acquire);
+        if (state) {
+            timed_mtx_state_free(state);
+            atomic_store_explicit(&mutex->timed, NULL, memory_order_relaxed);
+        }
+
+        return;
+    }
+
+    int err = pthread_mutex_destroy(&mutex->mutex);
+    if (err) {
+        report_error("pthread_mutex_destroy", err);
+    }
+}
+
+static int timed_mtx_acquire(mtx_t *mutex, const struct timespec *deadline, bool only_try) {
+    timed_mtx_state_t *state = timed_mtx_state(mutex);
+    if (!state) {
+        return thrd_error;
+    }
+
+    pthread_t self = pthread_self();
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&state->guard);
+    if (err) {
+        report_error("timed mutex pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    if (state->lock_count && pthread_equal(state->owner, self)) {
+        if (mutex->type & mtx_recursive) {
+            state->lock_count++;
+        } else if (only_try) {
+            res = thrd_busy;
+        } else {
+            report_error("timed mutex is not recursive but already held by current thread", EDEADLK);
+            res = thrd_error;
+        }
+        goto end;
+    }
+
+    while (state->lock_count) {
+        if (only_try) {
+            res = thrd_busy;
+            goto end;
+        }
+
+        state->waiters++;
+        err = cond_wait_until(&state->released, &state->guard, deadline);
+        state->waiters--;
+
+        if (err == ETIMEDOUT) {
+            if (state->lock_count) {
+                // lock is still held by another thread which will wake remaining waiters when unlocking
+                res = thrd_timedout;
+                goto end;
+            }
+        } else if (err) {
+            report_error("timed mutex pthread_cond_(timed)wait", err);
+            res = thrd_error;
+            goto end;
+        }
+    }
+
+    state->owner = self;
+    state->lock_count = 1;
+
+end:
+    err = pthread_mutex_unlock(&state->guard);
+    if (err) {
+        report_error("timed mutex pthread_mutex_unlock", err);
+        return thrd_error;
+    }
+
+    return res;
+}
+
+static int timed_mtx_release(mtx_t *mutex) {
+    // the owner has allocated the lock state when it acquired the mutex
+    timed_mtx_state_t *state = atomic_load_explicit(&mutex->timed, memory_order_acquire);
+    if (!state) {
+        report_error("timed mutex unlocked by thread not holding it", EPERM);
+        return thrd_error;
+    }
+
+    int res = thrd_success;
+    bool wake = false;
+
+    int err = pthread_mutex_lock(&state->guard);
+    if (err) {
+        report_error("timed mutex pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    if (!state->lock_count || !pthread_equal(state->owner, pthread_self())) {
+        report_error("timed mutex unlocked by thread not holding it", EPERM);
+        res = thrd_error;
+    } else {
+        state->lock_count--;
+        wake = !state->lock_count && state->waiters;
+    }
+
+    err = pthread_mutex_unlock(&state->guard);
+    if (err) {
+        report_error("timed mutex pthread_mutex_unlock", err);
+        return thrd_error;
+    }
+
+    if (wake) {
+        // waiters re-check the lock state, so it is fine to wake them after releasing the guard
+        err = pthread_cond_signal(&state->released);
+        if (err) {
+            report_error("timed mutex pthread_cond_signal", err);
+            return thrd_error;
+        }
+    }
+
+    return res;
+}
+
+#else
+// mutexes are locked through a state word waited on by address (see addr_wait); owners are only tracked if needed
+// for recursion or to detect deadlocks of timed mutexes, like the pthread-based implementation does
+#define ADDR_MTX_UNLOCKED (0)
+#define ADDR_MTX_LOCKED (1)
+#define ADDR_MTX_CONTENDED (2)
+
+#define ADDR_MTX_TRACKS_OWNER(mutex) ((mutex)->type & (mtx_recursive | mtx_timed))
+
+// only used for its address which identifies the current thread as owner
+static _Thread_local char addr_mtx_thread_marker;
+#define ADDR_MTX_SELF ((uintptr_t) &addr_mtx_thread_marker)
+
+static int raw_mtx_init(mtx_t *mutex, int type) {
+    if (!is_supported_mtx_type(type)) {
+        report_error("mtx_init unsupported type requested", EINVAL);
+        return thrd_error;
+    }
+
+    if (type & mtx_prio_inherit) {
+        // a state word waited on by address does not tell the kernel which thread owns it
+        report_error("mtx_init mtx_prio_inherit is not supported with THREADS_COMPAT_ADDR_WAIT", ENOTSUP);
+        return thrd_error;
+    }
+
+    mutex->type = type;
+    mutex->spin_count = THREADS_COMPAT_MTX_SPIN_COUNT;
+    mutex->spin_backoff_max = THREADS_COMPAT_MTX_SPIN_BACKOFF_MAX;
+
+    atomic_init(&mutex->state, ADDR_MTX_UNLOCKED);
+    atomic_init(&mutex->owner, 0);
+    mutex->lock_count = 0;
+    mutex->handoff_head = NULL;
+    mutex->handoff_tail = NULL;
+
+    return thrd_success;
+}
+
+static void raw_mtx_destroy(mtx_t *mutex) {
+    // nothing has been allocated
+    (void) mutex;
+}
+
+static inline bool addr_mtx_is_owned(mtx_t *mutex) {
+    // only we can have stored our own marker, so a relaxed load is sufficient
+    return ADDR_MTX_TRACKS_OWNER(mutex) && (atomic_load_explicit(&mutex->owner, memory_order_relaxed) == ADDR_MTX_SELF);
+}
+
+static int addr_mtx_relock(mtx_t *mutex, bool only_try) {
+    if (mutex->type & mtx_recursive) {
+        mutex->lock_count++;
+        return thrd_success;
+    }
+
+    if (only_try) {
+        return thrd_busy;
+    }
+
+    report_error("timed mutex is not recursive but already held by current thread", EDEADLK);
+    return thrd_error;
+}
+
+static inline void addr_mtx_acquired(mtx_t *mutex, unsigned int lock_count) {
+    if (ADDR_MTX_TRACKS_OWNER(mutex)) {
+        atomic_store_explicit(&mutex->owner, ADDR_MTX_SELF, memory_order_relaxed);
+        mutex->lock_count = lock_count;
+    }
+}
+
+static inline bool addr_mtx_try_acquire(mtx_t *mutex) {
+    unsigned int expected = ADDR_MTX_UNLOCKED;
+    return atomic_compare_exchange_strong_explicit(&mutex->state, &expected, ADDR_MTX_LOCKED, memory_order_acquire, memory_order_relaxed);
+}
+
+static int addr_mtx_acquire_contended(mtx_t *mutex, const struct timespec *deadline) {
+    // marking the mutex as contended makes the thread unlocking it wake up a waiter
+    while (atomic_exchange_explicit(&mutex->state, ADDR_MTX_CONTENDED, memory_order_acquire) != ADDR_MTX_UNLOCKED) {
+        int res = addr_wait_until(&mutex->state, ADDR_MTX_CONTENDED, deadline);
+        if (res != thrd_success) {
+            // state remains marked contended which just causes one unnecessary wake
+            return res;
+        }
+    }
+
+    return thrd_success;
+}
+
+// Condition waiters are recorded on their own stack and wait on the address of their state. Signalling removes the
+// first waiter from the condition and wakes it. Broadcasting removes all waiters but only wakes the first one, which
+// moves the others to the handoff queue of the mutex once it got hold of it (wait morphing): each release of the
+// mutex then wakes just one of them instead of all threads waking up at once only to block on the mutex again.
+#define CND_WAITER_QUEUED (0)
+#define CND_WAITER_SIGNALLED (1)
+#define CND_WAITER_WOKEN (2)
+
+typedef struct threads_compat_cnd_waiter {
+    struct threads_compat_cnd_waiter *prev;
+    struct threads_compat_cnd_waiter *next;
+    atomic_uint state;
+
+    // only set for the waiter woken by a broadcast, last of the waiters following it to be handed off to the mutex
+    struct threads_compat_cnd_waiter *handoff_tail;
+} cnd_waiter_t;
+
+static inline int cnd_waiter_wake(cnd_waiter_t *waiter) {
+    // the waiter may return as soon as it sees the state, so its record must not be accessed afterwards; waking an
+    // address which is no longer waited on is harmless
+    atomic_store_explicit(&waiter->state, CND_WAITER_WOKEN, memory_order_release);
+
+    return addr_wake_some(&waiter->state, false);
+}
+
+static inline int addr_mtx_release(mtx_t *mutex) {
+    // the handoff queue can only be changed while holding the mutex
+    cnd_waiter_t *handoff = mutex->handoff_head;
+    if (handoff) {
+        mutex->handoff_head = handoff->next;
+        if (!mutex->handoff_head) {
+            mutex->handoff_tail = NULL;
+        }
+    }
+
+    int res = thrd_success;
+    if (atomic_exchange_explicit(&mutex->state, ADDR_MTX_UNLOCKED, memory_order_release) == ADDR_MTX_CONTENDED) {
+        res = addr_wake_some(&mutex->state, false);
+    }
+
+    if (handoff) {
+        int wake_res = cnd_waiter_wake(handoff);
+        if (res == thrd_success) {
+            res = wake_res;
+        }
+    }
+
+    return res;
+}
+
+static int addr_mtx_disown(mtx_t *mutex, unsigned int *lock_count) {
+    // prepares releasing the mutex completely, lock_count receives the number of times it had been locked
+    if (ADDR_MTX_TRACKS_OWNER(mutex)) {
+        if (!addr_mtx_is_owned(mutex)) {
+            report_error("mutex unlocked by thread not holding it", EPERM);
+            return thrd_error;
+        }
+
+        *lock_count = mutex->lock_count;
+        atomic_store_explicit(&mutex->owner, 0, memory_order_relaxed);
+    } else if (atomic_load_explicit(&mutex->state, memory_order_relaxed) == ADDR_MTX_UNLOCKED) {
+        report_error("mutex unlocked while not being locked", EPERM);
+        return thrd_error;
+    }
+
+    return thrd_success;
+}
+#endif
+
+int mtx_set_spin(mtx_t *mutex, unsigned int spin_count, unsigned int backoff_max) {
+    mutex->spin_count = spin_count;
+    mutex->spin_backoff_max = backoff_max ? backoff_max : 1;
+
+    return thrd_success;
+}
+
+static int raw_mtx_trylock(mtx_t *mutex);
+
+static bool mtx_spin(mtx_t *mutex) {
+    unsigned int backoff = 1;
+
+    for (unsigned int i = 0; i < mutex->spin_count; i++) {
+        if (raw_mtx_trylock(mutex) == thrd_success) {
+            return true;
+        }
+
+        for (unsigned int j = 0; j < backoff; j++) {
+            threads_compat_cpu_relax();
+        }
+
+        if (backoff < mutex->spin_backoff_max) {
+            backoff = (backoff < mutex->spin_backoff_max / 2) ? (backoff << 1) : mutex->spin_backoff_max;
+        }
+    }
+
+    return false;
+}
+
+#ifndef THREADS_COMPAT_ADDR_WAIT
+static int raw_mtx_lock(mtx_t *mutex) {
+    if (mutex->spin_count && mtx_spin(mutex)) {
+        return thrd_success;
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        os_unfair_lock_lock(&mutex->unfair);
+        return thrd_success;
+    }
+#endif
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        return timed_mtx_acquire(mutex, NULL, false);
+    }
+
+    int err = pthread_mutex_lock(&mutex->mutex);
+    if (err) {
+        report_error("pthread_mutex_lock", err);
+    }
+
+    return err ? thrd_error : thrd_success;
+}
+
+static int raw_mtx_trylock(mtx_t *mutex) {
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        return os_unfair_lock_trylock(&mutex->unfair) ? thrd_success : thrd_busy;
+    }
+#endif
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        return timed_mtx_acquire(mutex, NULL, true);
+    }
+
+    int err = pthread_mutex_trylock(&mutex->mutex);
+    if (err) {
+        // error checking (timed) mutexes may report EDEADLK if already held by the current thread
+        if (err == EBUSY || err == EDEADLK) {
+            return thrd_busy;
+        } else {
+            report_error("pthread_mutex_trylock", err);
+        }
+    }
+
+    return err ? thrd_error : thrd_success;
+}
+
+static inline int untimed_mtx_trylock(mtx_t *mutex) {
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        return os_unfair_lock_trylock(&mutex->unfair) ? 0 : EBUSY;
+    }
+#endif
+
+    return pthread_mutex_trylock(&mutex->mutex);
+}
+
+static int raw_mtx_timedlock(mtx_t *mutex, const struct timespec *time_point) {
+    if (mutex->spin_count && mtx_spin(mutex)) {
+        return thrd_success;
+    }
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        struct timespec deadline = {0};
+        if (monotonic_deadline_from_utc(time_point, &deadline) != thrd_success) {
+            return thrd_error;
+        }
+
+        return timed_mtx_acquire(mutex, &deadline, false);
+    }
+
+#if defined(_POSIX_TIMEOUTS) && (_POSIX_TIMEOUTS > 0)
+    if ((mutex->type & mtx_prio_inherit) && !IS_UNFAIR_MUTEX(mutex)) {
+        // the owner can only inherit our priority while we are blocked on the mutex itself, so wait on it directly
+        // where supported; the time point is based on TIME_UTC as expected by pthread_mutex_timedlock
+        int err = pthread_mutex_timedlock(&mutex->mutex, time_point);
+        if (err == ETIMEDOUT) {
+            return thrd_timedout;
+        } else if (err) {
+            report_error("pthread_mutex_timedlock", err);
+            return thrd_error;
+        }
+
+        return thrd_success;
+    }
+#endif
+
+    // macOS does not have pthread_mutex_timedlock, so unfortunately we need to work around it for mutexes which have
+    // not been initialized as mtx_timed; the deadline is only converted once, each check then just reads the clock
+    struct timespec deadline = {0};
+    if (monotonic_deadline_from_utc(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    uint64_t deadline_nanos = timespec_to_nanos(&deadline);
+
+    while (true) {
+        int res = untimed_mtx_trylock(mutex);
+        if (!res) {
+            return thrd_success;
+        }
+
+        if (res != EBUSY) {
+            report_error("mtx_timedlock/pthread_mutex_trylock", res);
+            return thrd_error;
+        }
+
+        uint64_t now_nanos = clock_now_nanos();
+        if (now_nanos >= deadline_nanos) {
+            return thrd_timedout;
+        }
+
+        // sleep for the regular check interval or whatever remains until the deadline if that is shorter
+        uint64_t sleep_nanos = deadline_nanos - now_nanos;
+        if (sleep_nanos > THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS) {
+            sleep_nanos = THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS;
+        }
+
+        struct timespec sleep_time = {
+            .tv_sec = sleep_nanos / THREADS_COMPAT_NANOS_PER_SECOND,
+            .tv_nsec = sleep_nanos % THREADS_COMPAT_NANOS_PER_SECOND,
+        };
+
+        if (nanosleep(&sleep_time, NULL) && (errno != EINTR)) {
+            report_error("mtx_timedlock/nanosleep", errno);
+            return thrd_error;
+        }
+    }
+}
+
+static int raw_mtx_unlock(mtx_t *mutex) {
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        os_unfair_lock_unlock(&mutex->unfair);
+        return thrd_success;
+    }
+#endif
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        return timed_mtx_release(mutex);
+    }
+
+    int err = pthread_mutex_unlock(&mutex->mutex);
+    if (err) {
+        report_error("pthread_mutex_unlock", err);
+    }
+
+    return err ? thrd_error : thrd_success;
+}
+
+#else
+static int raw_mtx_lock(mtx_t *mutex) {
+    if (addr_mtx_is_owned(mutex)) {
+        return addr_mtx_relock(mutex, false);
+    }
+
+    if (addr_mtx_try_acquire(mutex) || (mutex->spin_count && mtx_spin(mutex))) {
+        addr_mtx_acquired(mutex, 1);
+        return thrd_success;
+    }
+
+    int res = addr_mtx_acquire_contended(mutex, NULL);
+    if (res == thrd_success) {
+        addr_mtx_acquired(mutex, 1);
+    }
+
+    return res;
+}
+
+static int raw_mtx_trylock(mtx_t *mutex) {
+    if (addr_mtx_is_owned(mutex)) {
+        return addr_mtx_relock(mutex, true);
+    }
+
+    if (!addr_mtx_try_acquire(mutex)) {
+        return thrd_busy;
+    }
+
+    addr_mtx_acquired(mutex, 1);
+    return thrd_success;
+}
+
+static int raw_mtx_timedlock(mtx_t *mutex, const struct timespec *time_point) {
+    if (addr_mtx_is_owned(mutex)) {
+        return addr_mtx_relock(mutex, false);
+    }
+
+    // the deadline only needs to be calculated if we actually have to wait
+    if (addr_mtx_try_acquire(mutex) || (mutex->spin_count && mtx_spin(mutex))) {
+        addr_mtx_acquired(mutex, 1);
+        return thrd_success;
+    }
+
+    struct timespec deadline = {0};
+    if (monotonic_deadline_from_utc(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    int res = addr_mtx_acquire_contended(mutex, &deadline);
+    if (res == thrd_success) {
+        addr_mtx_acquired(mutex, 1);
+    }
+
+    return res;
+}
+
+static int raw_mtx_unlock(mtx_t *mutex) {
+    if (addr_mtx_is_owned(mutex) && mutex->lock_count > 1) {
+        mutex->lock_count--;
+        return thrd_success;
+    }
+
+    unsigned int lock_count = 0;
+    if (addr_mtx_disown(mutex, &lock_count) != thrd_success) {
+        return thrd_error;
+    }
+
+    return addr_mtx_release(mutex);
+}
+#endif
+
+#ifdef THREADS_COMPAT_MTX_PROFILING
+static pthread_mutex_t mtx_profile_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static threads_compat_mtx_profile_t *mtx_profile_registry = NULL;
+
+static inline unsigned long long mtx_profile_now() {
+    return clock_now_nanos();
+}
+
+static inline void mtx_profile_increment(atomic_ullong *counter, unsigned long long value) {
+    // only called while holding the mutex, so no read-modify-write is needed; atomics just let readers see whole values
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static void mtx_profile_link(threads_compat_mtx_profile_t *profile) {
+    int err = pthread_mutex_lock(&mtx_profile_registry_mutex);
+    if (err) {
+        report_error("mtx profiling registry pthread_mutex_lock", err);
+        return;
+    }
+
+    if (!atomic_load_explicit(&profile->registered, memory_order_relaxed)) {
+        profile->next = mtx_profile_registry;
+        if (mtx_profile_registry) {
+            mtx_profile_registry->prev = profile;
+        }
+        mtx_profile_registry = profile;
+
+        atomic_store_explicit(&profile->registered, true, memory_order_release);
+    }
+
+    err = pthread_mutex_unlock(&mtx_profile_registry_mutex);
+    if (err) {
+        report_error("mtx profiling registry pthread_mutex_unlock", err);
+    }
+}
+
+static void mtx_profile_register(mtx_t *mutex) {
+    threads_compat_mtx_profile_t *profile = &mutex->profile;
+    memset(profile, 0, sizeof(*profile));
+
+    mtx_profile_link(profile);
+}
+
+static void mtx_profile_unregister(mtx_t *mutex) {
+    threads_compat_mtx_profile_t *profile = &mutex->profile;
+
+    int err = pthread_mutex_lock(&mtx_profile_registry_mutex);
+    if (err) {
+        report_error("mtx profiling registry pthread_mutex_lock", err);
+        return;
+    }
+
+    if (atomic_load_explicit(&profile->registered, memory_order_relaxed)) {
+        if (profile->prev) {
+            profile->prev->next = profile->next;
+        } else {
+            mtx_profile_registry = profile->next;
+        }
+        if (profile->next) {
+            profile->next->prev = profile->prev;
+        }
+        profile->prev = NULL;
+        profile->next = NULL;
+
+        atomic_store_explicit(&profile->registered, false, memory_order_relaxed);
+    }
+
+    err = pthread_mutex_unlock(&mtx_profile_registry_mutex);
+    if (err) {
+        report_error("mtx profiling registry pthread_mutex_unlock", err);
+    }
+}
+
+static void mtx_profile_acquired(mtx_t *mutex, bool contended, unsigned long long wait_start) {
+    threads_compat_mtx_profile_t *profile = &mutex->profile;
+    unsigned long long now = mtx_profile_now();
+
+    // statically initialized mutexes are registered when they are acquired for the first time
+    if (!atomic_load_explicit(&profile->registered, memory_order_acquire)) {
+        mtx_profile_link(profile);
+    }
+
+    // recursive locks are only timed from the outermost lock
+    if (!profile->depth++) {
+        profile->acquired_at = now;
+    }
+
+    mtx_profile_increment(&profile->acquisitions, 1);
+
+    if (contended) {
+        unsigned long long waited = (now > wait_start) ? (now - wait_start) : 0;
+        mtx_profile_increment(&profile->contended, 1);
+        mtx_profile_increment(&profile->wait_nanos_total, waited);
+        if (waited > atomic_load_explicit(&profile->wait_nanos_max, memory_order_relaxed)) {
+            atomic_store_explicit(&profile->wait_nanos_max, waited, memory_order_relaxed);
+        }
+    }
+}
+
+static void mtx_profile_record_hold(threads_compat_mtx_profile_t *profile) {
+    unsigned long long now = mtx_profile_now();
+    unsigned long long held = (now > profile->acquired_at) ? (now - profile->acquired_at) : 0;
+
+    unsigned int bucket = 0;
+    while (held > 1 && bucket < THREADS_COMPAT_MTX_HOLD_BUCKETS - 1) {
+        held >>= 1;
+        bucket++;
+    }
+
+    mtx_profile_increment(&profile->hold_histogram[bucket], 1);
+}
+
+static void mtx_profile_releasing(mtx_t *mutex) {
+    threads_compat_mtx_profile_t *profile = &mutex->profile;
+
+    if (!profile->depth) {
+        // not held by us (unlock will fail)
+        return;
+    }
+
+    if (!--profile->depth) {
+        mtx_profile_record_hold(profile);
+    }
+}
+
+static unsigned int mtx_profile_suspend(mtx_t *mutex) {
+    // condition waits release the mutex completely which ends the current hold time
+    threads_compat_mtx_profile_t *profile = &mutex->profile;
+    unsigned int depth = profile->depth;
+
+    if (depth) {
+        mtx_profile_record_hold(profile);
+        profile->depth = 0;
+    }
+
+    return depth;
+}
+
+static void mtx_profile_resume(mtx_t *mutex, unsigned int depth) {
+    threads_compat_mtx_profile_t *profile = &mutex->profile;
+
+    profile->depth = depth;
+    profile->acquired_at = mtx_profile_now();
+    mtx_profile_increment(&profile->acquisitions, 1);
+}
+#endif
+
+int mtx_init(mtx_t *mutex, int type) {
+    int res = raw_mtx_init(mutex, type);
+
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    if (res == thrd_success) {
+        mtx_profile_register(mutex);
+    }
+#endif
+
+    return res;
+}
+
+void mtx_destroy(mtx_t *mutex) {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    mtx_profile_unregister(mutex);
+#endif
+
+    raw_mtx_destroy(mutex);
+}
+
+static inline int profiled_mtx_lock(mtx_t *mutex) {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    // trying first tells contended from uncontended acquisitions and saves reading the clock for the latter
+    if (raw_mtx_trylock(mutex) == thrd_success) {
+        mtx_profile_acquired(mutex, false, 0);
+        return thrd_success;
+    }
+
+    unsigned long long wait_start = mtx_profile_now();
+    int res = raw_mtx_lock(mutex);
+    if (res == thrd_success) {
+        mtx_profile_acquired(mutex, true, wait_start);
+    }
+
+    return res;
+#else
+    return raw_mtx_lock(mutex);
+#endif
+}
+
+int mtx_trylock(mtx_t *mutex) {
+    int res = raw_mtx_trylock(mutex);
+
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    if (res == thrd_success) {
+        mtx_profile_acquired(mutex, false, 0);
+    } else if (res == thrd_busy) {
+        atomic_fetch_add_explicit(&mutex->profile.busy, 1, memory_order_relaxed);
+    }
+#endif
+
+    return res;
+}
+
+static inline int profiled_mtx_timedlock(mtx_t *mutex, const struct timespec *time_point) {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    if (raw_mtx_trylock(mutex) == thrd_success) {
+        mtx_profile_acquired(mutex, false, 0);
+        return thrd_success;
+    }
+
+    unsigned long long wait_start = mtx_profile_now();
+    int res = raw_mtx_timedlock(mutex, time_point);
+    if (res == thrd_success) {
+        mtx_profile_acquired(mutex, true, wait_start);
+    } else if (res == thrd_timedout) {
+        atomic_fetch_add_explicit(&mutex->profile.busy, 1, memory_order_relaxed);
+    }
+
+    return res;
+#else
+    return raw_mtx_timedlock(mutex, time_point);
+#endif
+}
+
+static inline int profiled_mtx_unlock(mtx_t *mutex) {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    // must be recorded while we still hold the mutex
+    mtx_profile_releasing(mutex);
+#endif
+
+    return raw_mtx_unlock(mutex);
+}
+
+int mtx_lock(mtx_t *mutex) {
+    trace_begin(span, "mtx_lock", mutex);
+    int res = profiled_mtx_lock(mutex);
+    trace_end(span, "mtx_lock");
+
+    return res;
+}
+
+int mtx_timedlock(mtx_t *mutex, const struct timespec *time_point) {
+    trace_begin(span, "mtx_timedlock", mutex);
+    int res = profiled_mtx_timedlock(mutex, time_point);
+    trace_end(span, "mtx_timedlock");
+
+    return res;
+}
+
+int mtx_unlock(mtx_t *mutex) {
+    trace_begin(span, "mtx_unlock", mutex);
+    int res = profiled_mtx_unlock(mutex);
+    trace_end(span, "mtx_unlock");
+
+    return res;
+}
+
+void mtx_set_name(mtx_t *mutex, const char *name) {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    mutex->profile.name = name;
+#else
+    (void) mutex;
+    (void) name;
+#endif
+}
+
+typedef struct threads_compat_thread {
+    thrd_start_t actual_func;
+    void *actual_arg;
+
+    // index + 1 of next free record in wrapped_thread_pool
+    atomic_uint next_free;
+
+#ifdef THREADS_COMPAT_THREAD_CACHE
+    // cached threads run multiple records, so they need to be kept until joined or detached; guarded by
+    // thread_cache_mutex
+    int res;
+    bool done;
+    bool joining;
+    bool detached;
+
+    // only identifies a thread which has not been started by thrd_create, see thrd_current
+    bool foreign;
+    bool finished_initialized;
+    pthread_cond_t finished;
+#endif
+} wrapped_thread_t;
+
+// Records are only needed to hand over function and argument to a new thread; they are released as soon as the thread
+// has started and the result is returned through pthread instead. Only a few records are thus in use at any time,
+// so they are taken from a static pool; the heap is only used if the pool is exhausted.
+static wrapped_thread_t wrapped_thread_pool[THREADS_COMPAT_THREAD_RECORDS];
+static atomic_uint wrapped_thread_pool_used = 0;
+
+// lock-free stack of released pool records; lower 32 bits hold index + 1 of the top record (0 if empty), upper 32 bits
+// are changed on every operation to prevent ABA issues
+static atomic_uint_least64_t wrapped_thread_free = 0;
+
+#define FREE_LIST_INDEX(head) ((uint32_t) ((head) & 0xFFFFFFFF))
+#define FREE_LIST_TAG(head) ((uint32_t) ((head) >> 32))
+#define FREE_LIST_HEAD(index, tag) ((((uint_least64_t) (tag)) << 32) | (index))
+
+static void* zmalloc(size_t size) {
+    // prevent zero allocation requests as some malloc implementations may corrupt in that case
+    if (size == 0) {
+        return NULL;
+    }
+
+    void *addr = malloc(size);
+    if (addr) {
+        memset(addr, 0, size);
+    }
+    return addr;
+}
+
+static wrapped_thread_t* acquire_wrapped_thread() {
+    uint_least64_t head = atomic_load_explicit(&wrapped_thread_free, memory_order_acquire);
+    while (FREE_LIST_INDEX(head)) {
+        wrapped_thread_t *wrapped = &wrapped_thread_pool[FREE_LIST_INDEX(head) - 1];
+        uint32_t next = atomic_load_explicit(&wrapped->next_free, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&wrapped_thread_free, &head, FREE_LIST_HEAD(next, FREE_LIST_TAG(head) + 1), memory_order_acquire, memory_order_acquire)) {
+            return wrapped;
+        }
+    }
+
+    // records which have never been used before are not on the free list yet
+    if (atomic_load_explicit(&wrapped_thread_pool_used, memory_order_relaxed) < THREADS_COMPAT_THREAD_RECORDS) {
+        unsigned int index = atomic_fetch_add_explicit(&wrapped_thread_pool_used, 1, memory_order_relaxed);
+        if (index < THREADS_COMPAT_THREAD_RECORDS) {
+            return &wrapped_thread_pool[index];
+        }
+    }
+
+    return zmalloc(sizeof(wrapped_thread_t));
+}
+
+static void release_wrapped_thread(wrapped_thread_t *wrapped) {
+    if (wrapped < wrapped_thread_pool || wrapped >= wrapped_thread_pool + THREADS_COMPAT_THREAD_RECORDS) {
+#ifdef THREADS_COMPAT_THREAD_CACHE
+        if (wrapped->finished_initialized) {
+            int err = pthread_cond_destroy(&wrapped->finished);
+            if (err) {
+                report_error("thread record pthread_cond_destroy", err);
+            }
+        }
+#endif
+
+        free(wrapped);
+        return;
+    }
+
+    uint32_t index = (uint32_t) (wrapped - wrapped_thread_pool) + 1;
+    uint_least64_t head = atomic_load_explicit(&wrapped_thread_free, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&wrapped->next_free, FREE_LIST_INDEX(head), memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&wrapped_thread_free, &head, FREE_LIST_HEAD(index, FREE_LIST_TAG(head) + 1), memory_order_release, memory_order_relaxed));
+}
+
+static bool thrd_attr_is_default(const thrd_attr_t *attr) {
+    return !attr || (!attr->stack_size && attr->qos_class == thrd_qos_unspecified && !attr->relative_priority);
+}
+
+static int init_pthread_attr(pthread_attr_t *attr, const thrd_attr_t *ex_attr, bool detached) {
+    int err = pthread_attr_init(attr);
+    if (err) {
+        report_error("pthread_attr_init", err);
+        return thrd_error;
+    }
+
+    if (detached) {
+        err = pthread_attr_setdetachstate(attr, PTHREAD_CREATE_DETACHED);
+        if (err) {
+            report_error("pthread_attr_setdetachstate", err);
+            goto fail;
+        }
+    }
+
+    if (!ex_attr) {
+        return thrd_success;
+    }
+
+    if (ex_attr->stack_size) {
+        // macOS requires stack sizes to be a multiple of the page size
+        size_t stack_size = ex_attr->stack_size;
+        long page_size = sysconf(_SC_PAGESIZE);
+        if (page_size > 0) {
+            stack_size = ((stack_size + page_size - 1) / page_size) * page_size;
+        }
+        if (stack_size < (size_t) PTHREAD_STACK_MIN) {
+            stack_size = PTHREAD_STACK_MIN;
+        }
+
+        err = pthread_attr_setstacksize(attr, stack_size);
+        if (err) {
+            report_error("pthread_attr_setstacksize", err);
+            goto fail;
+        }
+    }
+
+#ifdef __APPLE__
+    if (ex_attr->qos_class != thrd_qos_unspecified || ex_attr->relative_priority) {
+        qos_class_t qos_class = QOS_CLASS_UNSPECIFIED;
+        switch (ex_attr->qos_class) {
+            case thrd_qos_background: qos_class = QOS_CLASS_BACKGROUND; break;
+            case thrd_qos_utility: qos_class = QOS_CLASS_UTILITY; break;
+            case thrd_qos_default: qos_class = QOS_CLASS_DEFAULT; break;
+            case thrd_qos_user_initiated: qos_class = QOS_CLASS_USER_INITIATED; break;
+            case thrd_qos_user_interactive: qos_class = QOS_CLASS_USER_INTERACTIVE; break;
+            case thrd_qos_unspecified: break;
+            default:
+                report_error("thrd_create_ex unsupported QoS class requested", EINVAL);
+                goto fail;
+        }
+
+        err = pthread_attr_set_qos_class_np(attr, qos_class, ex_attr->relative_priority);
+        if (err) {
+            report_error("pthread_attr_set_qos_class_np", err);
+            goto fail;
+        }
+    }
+#endif
+
+    return thrd_success;
+
+fail:
+    err = pthread_attr_destroy(attr);
+    if (err) {
+        report_error("pthread_attr_destroy", err);
+    }
+
+    return thrd_error;
+}
+
+#ifdef THREADS_COMPAT_THREAD_CACHE
+static void tss_reset_thread();
+
+typedef struct cached_thread {
+    wrapped_thread_t *wrapped;
+
+    // dedicated threads have been started with non-default attributes, so they are not reused
+    bool dedicated;
+
+    pthread_cond_t wakeup;
+    struct cached_thread *next_parked;
+} cached_thread_t;
+
+// all cache state and records of cached threads are guarded by the same mutex
+static pthread_mutex_t thread_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cached_thread_t *thread_cache_parked = NULL;
+static unsigned int thread_cache_parked_count = 0;
+
+// cache entry of the current thread, NULL if it has not been started by thrd_create
+static _Thread_local cached_thread_t *thread_cache_current = NULL;
+
+// stands in for threads not started by thrd_create (e.g. the main thread) when calling thrd_current
+static _Thread_local wrapped_thread_t thread_foreign_record = {0};
+
+static void thread_cache_finish(wrapped_thread_t *wrapped, int res) {
+    // caller holds thread_cache_mutex; nobody is going to join a detached thread, so its record can be released now
+    if (wrapped->detached) {
+        release_wrapped_thread(wrapped);
+        return;
+    }
+
+    wrapped->res = res;
+    wrapped->done = true;
+    if (wrapped->joining) {
+        int err = pthread_cond_signal(&wrapped->finished);
+        if (err) {
+            report_error("thread cache pthread_cond_signal", err);
+        }
+    }
+}
+
+static bool thread_cache_park(cached_thread_t *cached) {
+    // caller holds thread_cache_mutex
+    if (thread_cache_parked_count >= THREADS_COMPAT_THREAD_CACHE_SIZE) {
+        return false;
+    }
+
+    cached->next_parked = thread_cache_parked;
+    thread_cache_parked = cached;
+    thread_cache_parked_count++;
+
+    struct timespec deadline = {0};
+    clock_now(&deadline);
+    struct timespec idle_time = {
+        .tv_sec = THREADS_COMPAT_THREAD_CACHE_IDLE_MILLIS / 1000,
+        .tv_nsec = (THREADS_COMPAT_THREAD_CACHE_IDLE_MILLIS % 1000) * 1000000,
+    };
+    timespec_add(&deadline, &idle_time);
+
+    while (!cached->wrapped) {
+        int err = cond_wait_until(&cached->wakeup, &thread_cache_mutex, &deadline);
+        if (cached->wrapped) {
+            break;
+        }
+
+        if (err) {
+            if (err != ETIMEDOUT) {
+                report_error("thread cache pthread_cond_(timed)wait", err);
+            }
+
+            // we have been idle for too long (or failed), leave the cache
+            cached_thread_t **link = &thread_cache_parked;
+            while (*link != cached) {
+                link = &(*link)->next_parked;
+            }
+            *link = cached->next_parked;
+            thread_cache_parked_count--;
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void* cached_thread_func(void *arg) {
+    cached_thread_t *cached = arg;
+    thread_cache_current = cached;
+
+    int err = pthread_mutex_lock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_lock", err);
+        return NULL;
+    }
+
+    do {
+        wrapped_thread_t *wrapped = cached->wrapped;
+
+        err = pthread_mutex_unlock(&thread_cache_mutex);
+        if (err) {
+            report_error("thread cache pthread_mutex_unlock", err);
+        }
+
+        int res = wrapped->actual_func(wrapped->actual_arg);
+        tss_reset_thread();
+
+        err = pthread_mutex_lock(&thread_cache_mutex);
+        if (err) {
+            report_error("thread cache pthread_mutex_lock", err);
+            return NULL;
+        }
+
+        thread_cache_finish(wrapped, res);
+        cached->wrapped = NULL;
+    } while (!cached->dedicated && thread_cache_park(cached));
+
+    err = pthread_mutex_unlock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_unlock", err);
+    }
+
+    err = pthread_cond_destroy(&cached->wakeup);
+    if (err) {
+        report_error("thread cache pthread_cond_destroy", err);
+    }
+
+    thread_cache_current = NULL;
+    free(cached);
+
+    return NULL;
+}
+
+static int thread_cache_start(wrapped_thread_t *wrapped, const thrd_attr_t *ex_attr) {
+    bool dedicated = !thrd_attr_is_default(ex_attr);
+
+    int err = pthread_mutex_lock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    cached_thread_t *cached = dedicated ? NULL : thread_cache_parked;
+    if (cached) {
+        thread_cache_parked = cached->next_parked;
+        thread_cache_parked_count--;
+
+        cached->wrapped = wrapped;
+        err = pthread_cond_signal(&cached->wakeup);
+        if (err) {
+            report_error("thread cache pthread_cond_signal", err);
+        }
+    }
+
+    err = pthread_mutex_unlock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_unlock", err);
+    }
+
+    if (cached) {
+        return thrd_success;
+    }
+
+    // no thread is waiting for work, start a new one
+    cached = zmalloc(sizeof(cached_thread_t));
+    if (!cached) {
+        report_error("thrd_create out of memory?", ENOMEM);
+        return thrd_nomem;
+    }
+
+    err = init_monotonic_cond(&cached->wakeup);
+    if (err) {
+        report_error("thread cache pthread_cond_init", err);
+        free(cached);
+        return thrd_error;
+    }
+
+    cached->wrapped = wrapped;
+    cached->dedicated = dedicated;
+
+    // cached threads are never joined through pthread
+    pthread_attr_t attr;
+    if (init_pthread_attr(&attr, ex_attr, true) != thrd_success) {
+        err = pthread_cond_destroy(&cached->wakeup);
+        if (err) {
+            report_error("thread cache pthread_cond_destroy", err);
+        }
+
+        free(cached);
+
+        return thrd_error;
+    }
+
+    pthread_t thread;
+    err = pthread_create(&thread, &attr, cached_thread_func, cached);
+
+    int fin_err = pthread_attr_destroy(&attr);
+    if (fin_err) {
+        report_error("pthread_attr_destroy", fin_err);
+    }
+
+    if (err) {
+        report_error("pthread_create", err);
+
+        fin_err = pthread_cond_destroy(&cached->wakeup);
+        if (fin_err) {
+            report_error("thread cache pthread_cond_destroy", fin_err);
+        }
+
+        free(cached);
+
+        return thrd_error;
+    }
+
+    return thrd_success;
+}
+
+static int raw_thrd_create_ex(thrd_t *thr, thrd_start_t func, void *arg, const thrd_attr_t *attr) {
+    wrapped_thread_t *wrapped = acquire_wrapped_thread();
+    if (!wrapped) {
+        report_error("thrd_create out of memory?", ENOMEM);
+        return thrd_error;
+    }
+
+    wrapped->actual_func = func;
+    wrapped->actual_arg = arg;
+    wrapped->res = 0;
+    wrapped->done = false;
+    wrapped->joining = false;
+    wrapped->detached = false;
+
+    int res = thread_cache_start(wrapped, attr);
+    if (res != thrd_success) {
+        release_wrapped_thread(wrapped);
+        return res;
+    }
+
+    *thr = wrapped;
+
+    return thrd_success;
+}
+#else
+static void* wrap_thread_func(void *arg) {
+    wrapped_thread_t *wrapped = arg;
+    thrd_start_t actual_func = wrapped->actual_func;
+    void *actual_arg = wrapped->actual_arg;
+    release_wrapped_thread(wrapped);
+
+    return (void*) (intptr_t) actual_func(actual_arg);
+}
+
+static int raw_thrd_create_ex(thrd_t *thr, thrd_start_t func, void *arg, const thrd_attr_t *attr) {
+    int res = thrd_success;
+
+    pthread_attr_t pthread_attr;
+    bool has_attr = !thrd_attr_is_default(attr);
+    if (has_attr && init_pthread_attr(&pthread_attr, attr, false) != thrd_success) {
+        return thrd_error;
+    }
+
+    wrapped_thread_t *wrapped = acquire_wrapped_thread();
+    if (!wrapped) {
+        report_error("thrd_create out of memory?", ENOMEM);
+        res = thrd_nomem;
+        goto end;
+    }
+
+    wrapped->actual_func = func;
+    wrapped->actual_arg = arg;
+
+    int err = pthread_create(thr, has_attr ? &pthread_attr : NULL, wrap_thread_func, wrapped);
+    if (err) {
+        report_error("pthread_create", err);
+        release_wrapped_thread(wrapped);
+        res = thrd_error;
+    }
+
+end:
+    if (has_attr) {
+        int fin_err = pthread_attr_destroy(&pthread_attr);
+        if (fin_err) {
+            report_error("pthread_attr_destroy", fin_err);
+        }
+    }
+
+    return res;
+}
+
+#endif
+
+int thrd_create_ex(thrd_t *thr, thrd_start_t func, void *arg, const thrd_attr_t *attr) {
+    trace_begin(span, "thrd_create", arg);
+    int res = raw_thrd_create_ex(thr, func, arg, attr);
+    trace_end(span, "thrd_create");
+
+    return res;
+}
+
+int thrd_create(thrd_t *thr, thrd_start_t func, void *arg) {
+    return thrd_create_ex(thr, func, arg, NULL);
+}
+
+#ifdef THREADS_COMPAT_PRECISE_SLEEP
+// The precise sleep waits for an absolute deadline of a monotonic clock, so wake-up latency does not add up when
+// resuming after interruptions, and spins for the final THREADS_COMPAT_SLEEP_SPIN_NANOS to make up for the latency
+// of the last wake-up (timer coalescing). Deadlines are kept in units of the clock to avoid converting on every check.
+#ifdef __APPLE__
+static inline uint64_t sleep_clock_from_nanos(uint64_t nanos, bool to_clock) {
+    return to_clock ? clock_ticks_from_nanos(nanos) : clock_nanos_from_ticks(nanos);
+}
+
+static inline uint64_t sleep_clock_now() {
+    return mach_absolute_time();
+}
+
+static int sleep_clock_wait_until(uint64_t deadline) {
+    kern_return_t res = mach_wait_until(deadline);
+    if (res == KERN_SUCCESS) {
+        return 0;
+    }
+
+    if (res == KERN_ABORTED) {
+        return -1;
+    }
+
+    report_error("thrd_sleep mach_wait_until", EINVAL);
+    return -2;
+}
+#else
+static inline uint64_t sleep_clock_from_nanos(uint64_t nanos, bool to_clock) {
+    (void) to_clock;
+    return nanos;
+}
+
+static inline uint64_t sleep_clock_now() {
+    return clock_now_nanos();
+}
+
+static int sleep_clock_wait_until(uint64_t deadline) {
+    struct timespec time_point = {
+        .tv_sec = deadline / THREADS_COMPAT_NANOS_PER_SECOND,
+        .tv_nsec = deadline % THREADS_COMPAT_NANOS_PER_SECOND
+    };
+
+    int err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time_point, NULL);
+    if (!err) {
+        return 0;
+    }
+
+    if (err == EINTR) {
+        return -1;
+    }
+
+    report_error("thrd_sleep clock_nanosleep", err);
+    return -2;
+}
+#endif
+
+static int precise_sleep(const struct timespec *duration, struct timespec *remaining) {
+    if ((duration->tv_sec < 0) || (duration->tv_nsec < 0) || (duration->tv_nsec >= THREADS_COMPAT_NANOS_PER_SECOND)) {
+        report_error("thrd_sleep duration", EINVAL);
+        return -2;
+    }
+
+    uint64_t start = sleep_clock_now();
+
+    // very long durations saturate instead of overflowing
+    uint64_t nanos = timespec_to_nanos(duration);
+
+    uint64_t length = sleep_clock_from_nanos(nanos, true);
+    uint64_t deadline = (length < UINT64_MAX - start) ? start + length : UINT64_MAX;
+    uint64_t spin = sleep_clock_from_nanos(THREADS_COMPAT_SLEEP_SPIN_NANOS, true);
+
+    if (length > spin) {
+        int res = sleep_clock_wait_until(deadline - spin);
+        if (res) {
+            if ((res == -1) && remaining) {
+                uint64_t now = sleep_clock_now();
+                uint64_t remaining_nanos = (now < deadline) ? sleep_clock_from_nanos(deadline - now, false) : 0;
+                remaining->tv_sec = remaining_nanos / THREADS_COMPAT_NANOS_PER_SECOND;
+                remaining->tv_nsec = remaining_nanos % THREADS_COMPAT_NANOS_PER_SECOND;
+            }
+
+            return res;
+        }
+    }
+
+    while (sleep_clock_now() < deadline) {
+        threads_compat_cpu_relax();
+    }
+
+    return 0;
+}
+#endif
+
+int thrd_sleep(const struct timespec *duration, struct timespec *remaining) {
+#ifdef THREADS_COMPAT_PRECISE_SLEEP
+    return precise_sleep(duration, remaining);
+#else
+    // C11 requires 0 on success, -1 if interrupted and any other negative value on errors
+    if (!nanosleep(duration, remaining)) {
+        return 0;
+    }
+
+    if (errno == EINTR) {
+        return -1;
+    }
+
+    report_error("thrd_sleep nanosleep", errno);
+    return -2;
+#endif
+}
+
+#ifdef THREADS_COMPAT_THREAD_CACHE
+static int raw_thrd_join(thrd_t thr, int *res) {
+    wrapped_thread_t *wrapped = thr;
+    if (wrapped->foreign) {
+        report_error("thrd_join thread has not been started by thrd_create", EINVAL);
+        return thrd_error;
+    }
+
+    int err = pthread_mutex_lock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    if (!wrapped->done) {
+        // records are reused, so the condition only needs to be initialized once
+        if (!wrapped->finished_initialized) {
+            err = pthread_cond_init(&wrapped->finished, NULL);
+            if (err) {
+                report_error("thread record pthread_cond_init", err);
+                err = pthread_mutex_unlock(&thread_cache_mutex);
+                if (err) {
+                    report_error("thread cache pthread_mutex_unlock", err);
+                }
+
+                return thrd_error;
+            }
+            wrapped->finished_initialized = true;
+        }
+
+        wrapped->joining = true;
+        while (!wrapped->done) {
+            err = pthread_cond_wait(&wrapped->finished, &thread_cache_mutex);
+            if (err) {
+                report_error("thread record pthread_cond_wait", err);
+                err = pthread_mutex_unlock(&thread_cache_mutex);
+                if (err) {
+                    report_error("thread cache pthread_mutex_unlock", err);
+                }
+
+                return thrd_error;
+            }
+        }
+    }
+
+    if (res) {
+        *res = wrapped->res;
+    }
+
+    err = pthread_mutex_unlock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_unlock", err);
+    }
+
+    release_wrapped_thread(wrapped);
+
+    return thrd_success;
+}
+#else
+static int raw_thrd_join(thrd_t thr, int *res) {
+    void *thread_res = NULL;
+    int err = pthread_join(thr, &thread_res);
+    if (err) {
+        report_error("pthread_join", err);
+        return thrd_error;
+    }
+
+    if (res) {
+        *res = (int) (intptr_t) thread_res;
+    }
+
+    return thrd_success;
+}
+#endif
+
+int thrd_join(thrd_t thr, int *res) {
+    trace_begin(span, "thrd_join", (const void*) (uintptr_t) thr);
+    int raw_res = raw_thrd_join(thr, res);
+    trace_end(span, "thrd_join");
+
+    return raw_res;
+}
+
+#ifdef THREADS_COMPAT_THREAD_CACHE
+int thrd_detach(thrd_t thr) {
+    wrapped_thread_t *wrapped = thr;
+    if (wrapped->foreign) {
+        report_error("thrd_detach thread has not been started by thrd_create", EINVAL);
+        return thrd_error;
+    }
+
+    int err = pthread_mutex_lock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    // a thread which is still running releases its own record when it finishes
+    bool done = wrapped->done;
+    wrapped->detached = !done;
+
+    err = pthread_mutex_unlock(&thread_cache_mutex);
+    if (err) {
+        report_error("thread cache pthread_mutex_unlock", err);
+    }
+
+    if (done) {
+        release_wrapped_thread(wrapped);
+    }
+
+    return thrd_success;
+}
+
+_Noreturn void thrd_exit(int res) {
+    cached_thread_t *cached = thread_cache_current;
+    if (cached) {
+        // pthread_exit unwinds the stack of the cached thread, so it cannot return to the cache; the record is finished
+        // as if the function had returned, so the result still reaches thrd_join
+        tss_reset_thread();
+
+        int err = pthread_mutex_lock(&thread_cache_mutex);
+        if (err) {
+            report_error("thread cache pthread_mutex_lock", err);
+        } else {
+            thread_cache_finish(cached->wrapped, res);
+            cached->wrapped = NULL;
+
+            err = pthread_mutex_unlock(&thread_cache_mutex);
+            if (err) {
+                report_error("thread cache pthread_mutex_unlock", err);
+            }
+        }
+
+        thread_cache_current = NULL;
+
+        err = pthread_cond_destroy(&cached->wakeup);
+        if (err) {
+            report_error("thread cache pthread_cond_destroy", err);
+        }
+
+        free(cached);
+    }
+
+    pthread_exit(NULL);
+}
+
+thrd_t thrd_current() {
+    cached_thread_t *cached = thread_cache_current;
+    if (cached) {
+        return cached->wrapped;
+    }
+
+    thread_foreign_record.foreign = true;
+    return &thread_foreign_record;
+}
+
+int thrd_equal(thrd_t lhs, thrd_t rhs) {
+    return lhs == rhs;
+}
+#else
+int thrd_detach(thrd_t thr) {
+    // the record has already been released when the thread started, pthread keeps the result only until joined
+    int err = pthread_detach(thr);
+    if (err) {
+        report_error("pthread_detach", err);
+        return thrd_error;
+    }
+
+    return thrd_success;
+}
+
+_Noreturn void thrd_exit(int res) {
+    // returned by pthread_join just like the result of the thread function, see wrap_thread_func
+    pthread_exit((void*) (intptr_t) res);
+}
+
+thrd_t thrd_current() {
+    return pthread_self();
+}
+
+int thrd_equal(thrd_t lhs, thrd_t rhs) {
+    return pthread_equal(lhs, rhs);
+}
+#endif
+
+void thrd_yield() {
+    sched_yield();
+}
+
+#ifndef THREADS_COMPAT_ADDR_WAIT
+int cnd_init(cnd_t *cond) {
+    int err = init_monotonic_cond(&cond->cond);
+    if (err) {
+        report_error("pthread_cond_init", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    err = pthread_mutex_init(&cond->guard, NULL);
+    if (err) {
+        report_error("pthread_mutex_init", err);
+
+        int fin_err = pthread_cond_destroy(&cond->cond);
+        if (fin_err) {
+            report_error("pthread_cond_destroy", fin_err);
+        }
+
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+#endif
+
+    LAZY_COND_SET_INITIALIZED(&cond->cond_initialized);
+    atomic_init(&cond->waiters, 0);
+
+    return thrd_success;
+}
+
+void cnd_destroy(cnd_t *cond) {
+    int err = 0;
+    if (LAZY_COND_IS_INITIALIZED(&cond->cond_initialized)) {
+        err = pthread_cond_destroy(&cond->cond);
+        if (err) {
+            report_error("pthread_cond_destroy", err);
+        }
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    err = pthread_mutex_destroy(&cond->guard);
+    if (err) {
+        report_error("pthread_mutex_destroy", err);
+    }
+#endif
+}
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+static int unfair_mtx_cnd_wait(cnd_t *cond, mtx_t *mutex, const struct timespec *deadline) {
+    // guard is locked before releasing the unfair lock and all signalling also locks it, so no signal can get lost
+    // before we actually wait
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&cond->guard);
+    if (err) {
+        report_error("condition guard pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    os_unfair_lock_unlock(&mutex->unfair);
+
+    err = cond_wait_until(&cond->cond, &cond->guard, deadline);
+
+    if (err == ETIMEDOUT) {
+        res = thrd_timedout;
+    } else if (err) {
+        report_error("pthread_cond_(timed)wait", err);
+        res = thrd_error;
+    }
+
+    err = pthread_mutex_unlock(&cond->guard);
+    if (err) {
+        report_error("condition guard pthread_mutex_unlock", err);
+        res = thrd_error;
+    }
+
+    // the unfair lock must not be acquired while holding guard as signalling threads may hold it while locking guard
+    os_unfair_lock_lock(&mutex->unfair);
+
+    return res;
+}
+#endif
+
+static int timed_mtx_cnd_wait(cnd_t *cond, mtx_t *mutex, const struct timespec *deadline) {
+    // the condition variable waits on the guard, so we need to release the actual lock state first and restore it
+    // after waking up
+    timed_mtx_state_t *state = atomic_load_explicit(&mutex->timed, memory_order_acquire);
+    if (!state) {
+        report_error("condition waited on with timed mutex not held by current thread", EPERM);
+        return thrd_error;
+    }
+
+    pthread_t self = pthread_self();
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&state->guard);
+    if (err) {
+        report_error("timed mutex pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    if (!state->lock_count || !pthread_equal(state->owner, self)) {
+        report_error("condition waited on with timed mutex not held by current thread", EPERM);
+        res = thrd_error;
+        goto end;
+    }
+
+    unsigned int lock_count = state->lock_count;
+    state->lock_count = 0;
+    if (state->waiters) {
+        err = pthread_cond_signal(&state->released);
+        if (err) {
+            report_error("timed mutex pthread_cond_signal", err);
+        }
+    }
+
+    err = cond_wait_until(&cond->cond, &state->guard, deadline);
+
+    if (err == ETIMEDOUT) {
+        res = thrd_timedout;
+    } else if (err) {
+        report_error("pthread_cond_(timed)wait", err);
+        res = thrd_error;
+    }
+
+    // C11 requires the mutex to be locked again on return, no matter if we timed out or failed
+    while (state->lock_count) {
+        state->waiters++;
+        err = pthread_cond_wait(&state->released, &state->guard);
+        state->waiters--;
+
+        if (err) {
+            report_error("timed mutex pthread_cond_wait", err);
+            res = thrd_error;
+            goto end;
+        }
+    }
+
+    state->owner = self;
+    state->lock_count = lock_count;
+
+end:
+    err = pthread_mutex_unlock(&state->guard);
+    if (err) {
+        report_error("timed mutex pthread_mutex_unlock", err);
+        return thrd_error;
+    }
+
+    return res;
+}
+
+static int cnd_wait_any(cnd_t *cond, mtx_t *mutex, const struct timespec *deadline) {
+    int err = LAZY_COND_INIT(&cond->cond, &cond->cond_initialized);
+    if (err) {
+        report_error("pthread_cond_init", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if (IS_UNFAIR_MUTEX(mutex)) {
+        return unfair_mtx_cnd_wait(cond, mutex, deadline);
+    }
+#endif
+
+    if (IS_COND_TIMED_MUTEX(mutex)) {
+        return timed_mtx_cnd_wait(cond, mutex, deadline);
+    }
+
+    err = cond_wait_until(&cond->cond, &mutex->mutex, deadline);
+    if (err) {
+        if (err == ETIMEDOUT) {
+            return thrd_timedout;
+        }
+
+        report_error("pthread_cond_(timed)wait", err);
+        return thrd_error;
+    }
+    
+    return thrd_success;
+}
+
+#else
+// condition variables are a list of waiters (see cnd_waiter_t) guarded by a lock word
+int cnd_init(cnd_t *cond) {
+    atomic_init(&cond->guard, ADDR_MTX_UNLOCKED);
+    atomic_init(&cond->waiters, 0);
+    cond->head = NULL;
+    cond->tail = NULL;
+
+    return thrd_success;
+}
+
+void cnd_destroy(cnd_t *cond) {
+    // nothing has been allocated
+    (void) cond;
+}
+
+static void cnd_guard_lock(cnd_t *cond) {
+    // only held for a few list operations, so it is hardly ever contended
+    unsigned int expected = ADDR_MTX_UNLOCKED;
+    if (atomic_compare_exchange_strong_explicit(&cond->guard, &expected, ADDR_MTX_LOCKED, memory_order_acquire, memory_order_relaxed)) {
+        return;
+    }
+
+    while (atomic_exchange_explicit(&cond->guard, ADDR_MTX_CONTENDED, memory_order_acquire) != ADDR_MTX_UNLOCKED) {
+        addr_wait_until(&cond->guard, ADDR_MTX_CONTENDED, NULL);
+    }
+}
+
+static void cnd_guard_unlock(cnd_t *cond) {
+    if (atomic_exchange_explicit(&cond->guard, ADDR_MTX_UNLOCKED, memory_order_release) == ADDR_MTX_CONTENDED) {
+        addr_wake_some(&cond->guard, false);
+    }
+}
+
+static bool cnd_dequeue(cnd_t *cond, cnd_waiter_t *waiter) {
+    // removes a waiter which has not been signalled yet, returns false if the waiter is no longer queued
+    cnd_guard_lock(cond);
+
+    bool queued = (atomic_load_explicit(&waiter->state, memory_order_relaxed) == CND_WAITER_QUEUED);
+    if (queued) {
+        if (waiter->prev) {
+            waiter->prev->next = waiter->next;
+        } else {
+            cond->head = waiter->next;
+        }
+
+        if (waiter->next) {
+            waiter->next->prev = waiter->prev;
+        } else {
+            cond->tail = waiter->prev;
+        }
+    }
+
+    cnd_guard_unlock(cond);
+
+    return queued;
+}
+
+static int cnd_wait_any(cnd_t *cond, mtx_t *mutex, const struct timespec *deadline) {
+    unsigned int lock_count = 0;
+    if (addr_mtx_disown(mutex, &lock_count) != thrd_success) {
+        return thrd_error;
+    }
+
+    cnd_waiter_t waiter = {
+        .prev = NULL,
+        .next = NULL,
+        .handoff_tail = NULL,
+    };
+    atomic_init(&waiter.state, CND_WAITER_QUEUED);
+
+    // we are queued before releasing the mutex, so any signal after that will find us
+    cnd_guard_lock(cond);
+    waiter.prev = cond->tail;
+    if (cond->tail) {
+        cond->tail->next = &waiter;
+    } else {
+        cond->head = &waiter;
+    }
+    cond->tail = &waiter;
+    cnd_guard_unlock(cond);
+
+    // the mutex is released even if waking a thread waiting for it failed, so we still need to wait
+    int res = addr_mtx_release(mutex);
+
+    unsigned int state = 0;
+    while ((state = atomic_load_explicit(&waiter.state, memory_order_acquire)) != CND_WAITER_WOKEN) {
+        int wait_res = addr_wait_until(&waiter.state, state, deadline);
+        if (wait_res == thrd_success) {
+            continue;
+        }
+
+        // timed out (or failed); only waiters which have not been signalled yet can leave, all others are still
+        // referenced by a signalling thread or the handoff queue of the mutex and will be woken up shortly
+        if (cnd_dequeue(cond, &waiter)) {
+            res = wait_res;
+            break;
+        }
+
+        deadline = NULL;
+    }
+
+    // C11 requires the mutex to be locked again on return, no matter if we timed out or failed; other threads may
+    // be waiting for it, so the mutex has to be marked as contended
+    int lock_res = addr_mtx_acquire_contended(mutex, NULL);
+    if (lock_res != thrd_success) {
+        return thrd_error;
+    }
+
+    addr_mtx_acquired(mutex, lock_count);
+
+    if (waiter.handoff_tail) {
+        // we have been woken by a broadcast, the waiters following us are handed off to the mutex now that we hold it
+        cnd_waiter_t *handoff_head = waiter.next;
+        if (mutex->handoff_tail) {
+            mutex->handoff_tail->next = handoff_head;
+        } else {
+            mutex->handoff_head = handoff_head;
+        }
+        mutex->handoff_tail = waiter.handoff_tail;
+    }
+
+    return res;
+}
+#endif
+
+static int cnd_counted_wait(cnd_t *cond, mtx_t *mutex, const struct timespec *deadline) {
+    // waiters are only counted while holding the mutex, so any thread signalling after changing state under that
+    // mutex is guaranteed to see us; relaxed order is sufficient as the mutex already synchronizes
+    atomic_fetch_add_explicit(&cond->waiters, 1, memory_order_relaxed);
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    unsigned int profile_depth = mtx_profile_suspend(mutex);
+#endif
+    int res = cnd_wait_any(cond, mutex, deadline);
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    mtx_profile_resume(mutex, profile_depth);
+#endif
+    atomic_fetch_sub_explicit(&cond->waiters, 1, memory_order_relaxed);
+
+    return res;
+}
+
+int cnd_wait(cnd_t *cond, mtx_t *mutex) {
+    trace_begin(span, "cnd_wait", cond);
+    int res = cnd_counted_wait(cond, mutex, NULL);
+    trace_end(span, "cnd_wait");
+
+    return res;
+}
+
+int cnd_timedwait(cnd_t *cond, mtx_t *mutex, const struct timespec *time_point) {
+    struct timespec deadline = {0};
+    if (monotonic_deadline_from_utc(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    trace_begin(span, "cnd_timedwait", cond);
+    int res = cnd_counted_wait(cond, mutex, &deadline);
+    trace_end(span, "cnd_timedwait");
+
+    return res;
+}
+
+int cnd_timedwait_monotonic(cnd_t *cond, mtx_t *mutex, const struct timespec *time_point) {
+    struct timespec deadline = {0};
+    if (monotonic_deadline_from_clock_monotonic(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    trace_begin(span, "cnd_timedwait", cond);
+    int res = cnd_counted_wait(cond, mutex, &deadline);
+    trace_end(span, "cnd_timedwait");
+
+    return res;
+}
+
+#ifndef THREADS_COMPAT_ADDR_WAIT
+static int cnd_wake(cnd_t *cond, bool all) {
+    if (!atomic_load_explicit(&cond->waiters, memory_order_relaxed)) {
+        // nobody is waiting, no need to bother the system
+        return thrd_success;
+    }
+
+    // waiters have initialized the condition variable, but we need to see that
+    int err = LAZY_COND_INIT(&cond->cond, &cond->cond_initialized);
+    if (err) {
+        report_error("pthread_cond_init", err);
+        return thrd_error;
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    err = pthread_mutex_lock(&cond->guard);
+    if (err) {
+        report_error("condition guard pthread_mutex_lock", err);
+        return thrd_error;
+    }
+#endif
+
+    int res = thrd_success;
+    int cnd_err = all ? pthread_cond_broadcast(&cond->cond) : pthread_cond_signal(&cond->cond);
+    if (cnd_err) {
+        report_error(all ? "pthread_cond_broadcast" : "pthread_cond_signal", cnd_err);
+        res = thrd_error;
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    err = pthread_mutex_unlock(&cond->guard);
+    if (err) {
+        report_error("condition guard pthread_mutex_unlock", err);
+        res = thrd_error;
+    }
+#endif
+
+    return res;
+}
+
+#else
+static int cnd_wake(cnd_t *cond, bool all) {
+    if (!atomic_load_explicit(&cond->waiters, memory_order_relaxed)) {
+        // nobody is waiting, no need to bother the system
+        return thrd_success;
+    }
+
+    cnd_guard_lock(cond);
+    cnd_waiter_t *first = cond->head;
+    if (!first) {
+        cnd_guard_unlock(cond);
+        return thrd_success;
+    }
+
+    if (all) {
+        // the waiters stay linked by next, the first one moves the others over to the mutex
+        for (cnd_waiter_t *waiter = first->next; waiter; waiter = waiter->next) {
+            atomic_store_explicit(&waiter->state, CND_WAITER_SIGNALLED, memory_order_relaxed);
+        }
+
+        first->handoff_tail = (cond->tail != first) ? cond->tail : NULL;
+        cond->head = NULL;
+        cond->tail = NULL;
+    } else {
+        cond->head = first->next;
+        if (cond->head) {
+            cond->head->prev = NULL;
+        } else {
+            cond->tail = NULL;
+        }
+        first->next = NULL;
+    }
+
+    // the first waiter cannot leave on its own anymore once it is no longer queued
+    atomic_store_explicit(&first->state, CND_WAITER_SIGNALLED, memory_order_relaxed);
+    cnd_guard_unlock(cond);
+
+    return cnd_waiter_wake(first);
+}
+#endif
+
+int cnd_signal(cnd_t *cond) {
+    trace_begin(span, "cnd_signal", cond);
+    int res = cnd_wake(cond, false);
+    trace_end(span, "cnd_signal");
+
+    return res;
+}
+
+int cnd_broadcast(cnd_t *cond) {
+    trace_begin(span, "cnd_broadcast", cond);
+    int res = cnd_wake(cond, true);
+    trace_end(span, "cnd_broadcast");
+
+    return res;
+}
+
+int threads_compat_monotonic_deadline(const struct timespec *time_point, struct timespec *deadline) {
+    return monotonic_deadline_from_utc(time_point, deadline);
+}
+
+int threads_compat_init_monotonic_cond(pthread_cond_t *cond) {
+    return init_monotonic_cond(cond);
+}
+
+int threads_compat_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline) {
+    return cond_wait_until(cond, mutex, deadline);
+}
+
+int threads_compat_addr_wait_until(atomic_uint *address, unsigned int expected, const struct timespec *deadline) {
+    return addr_wait_until(address, expected, deadline);
+}
+
+int threads_compat_mtx_lock_slow(mtx_t *mutex) {
+    return mtx_lock(mutex);
+}
+
+int threads_compat_mtx_trylock_slow(mtx_t *mutex) {
+    return mtx_trylock(mutex);
+}
+
+int threads_compat_mtx_unlock_slow(mtx_t *mutex) {
+    return mtx_unlock(mutex);
+}
+
+int threads_compat_cnd_wake_slow(cnd_t *cond, int all) {
+    return all ? cnd_broadcast(cond) : cnd_signal(cond);
+}
+
+int threads_compat_inline_error(const char *site, int err) {
+    report_error(site, err);
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+    (void) site;
+    (void) err;
 #endif
 
-#define THREADS_COMPAT_NANOS_PER_SECOND (1000000000)
-#define THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_FULL_SECONDS (THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS / THREADS_COMPAT_NANOS_PER_SECOND)
-#define THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOSECOND_PART (THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOS % THREADS_COMPAT_NANOS_PER_SECOND)
+    return thrd_error;
+}
 
-int mtx_init(mtx_t *mutex, int type) {
-    int err = 0;
-    int fin_err = 0;
+_Thread_local threads_compat_tss_block_t *threads_compat_tss_block = NULL;
 
-    if (type != mtx_plain && type != (mtx_plain | mtx_recursive)) {
-        printf("[threads_macos_compat] mtx_init unsupported type requested: %d\n", type);
-        return thrd_error;
-    }
+static struct {
+    bool in_use;
+    unsigned int generation;
+    tss_dtor_t dtor;
+} tss_keys[THREADS_COMPAT_TSS_MAX] = {0};
 
-    pthread_mutexattr_t attr = {0};
-    err = pthread_mutexattr_init(&attr);
+static unsigned int tss_last_generation = 0;
+static pthread_mutex_t tss_keys_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tss_block_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tss_block_key;
+static int tss_block_key_err = 0;
+
+int tss_create(tss_t *key, tss_dtor_t dtor) {
+    int res = thrd_error;
+
+    int err = pthread_mutex_lock(&tss_keys_mutex);
     if (err) {
-        printf("[threads_macos_compat] pthread_mutexattr_init error: %d %s\n", err, strerror(err));
+        report_error("tss_create pthread_mutex_lock", err);
         return thrd_error;
     }
-    
-    if (type & mtx_recursive) {
-        err = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-        if (err) {
-            printf("[threads_macos_compat] pthread_mutexattr_settype PTHREAD_MUTEX_RECURSIVE error: %d %s\n", err, strerror(err));
-            goto end;
+
+    for (unsigned int i = 0; i < THREADS_COMPAT_TSS_MAX; i++) {
+        if (tss_keys[i].in_use) {
+            continue;
         }
+
+        // generation 0 is never used so zeroed slots of a thread's block never yield any value
+        tss_last_generation++;
+        if (!tss_last_generation) {
+            tss_last_generation++;
+        }
+
+        tss_keys[i].in_use = true;
+        tss_keys[i].generation = tss_last_generation;
+        tss_keys[i].dtor = dtor;
+
+        key->index = i;
+        key->generation = tss_last_generation;
+
+        res = thrd_success;
+        break;
     }
-    
-    err = pthread_mutex_init(mutex, &attr);
+
+    err = pthread_mutex_unlock(&tss_keys_mutex);
     if (err) {
-        printf("[threads_macos_compat] pthread_mutex_init error: %d %s\n", err, strerror(err));
+        report_error("tss_create pthread_mutex_unlock", err);
     }
 
-end:
-    fin_err = pthread_mutexattr_destroy(&attr);
-    if (fin_err) {
-        printf("[threads_macos_compat] pthread_mutexattr_destroy error: %d %s\n", fin_err, strerror(fin_err));
+    if (res != thrd_success) {
+        report_error("tss_create out of keys (THREADS_COMPAT_TSS_MAX)", EAGAIN);
     }
-    
-    return err ? thrd_error : thrd_success;
+
+    return res;
 }
 
-void mtx_destroy(mtx_t *mutex) {
-    int err = pthread_mutex_destroy(mutex);
+void tss_delete(tss_t key) {
+    // C11 does not call any destructors on deletion; values remaining in thread blocks are simply hidden by the
+    // generation changing once the index gets reused
+    int err = pthread_mutex_lock(&tss_keys_mutex);
+    if (err) {
+        report_error("tss_delete pthread_mutex_lock", err);
+        return;
+    }
+
+    if (tss_keys[key.index].in_use && tss_keys[key.index].generation == key.generation) {
+        tss_keys[key.index].in_use = false;
+        tss_keys[key.index].dtor = NULL;
+    }
+
+    err = pthread_mutex_unlock(&tss_keys_mutex);
     if (err) {
-        printf("[threads_macos_compat] pthread_mutex_destroy error: %d %s\n", err, strerror(err));
+        report_error("tss_delete pthread_mutex_unlock", err);
     }
 }
 
-int mtx_lock(mtx_t *mutex) {
-    int err = pthread_mutex_lock(mutex);
+static tss_dtor_t tss_get_dtor(unsigned int index, unsigned int generation) {
+    tss_dtor_t dtor = NULL;
+
+    int err = pthread_mutex_lock(&tss_keys_mutex);
     if (err) {
-        printf("[threads_macos_compat] pthread_mutex_lock error: %d %s\n", err, strerror(err));
+        report_error("tss destructor pthread_mutex_lock", err);
+        return NULL;
     }
 
-    return err ? thrd_error : thrd_success;
-}
+    if (tss_keys[index].in_use && tss_keys[index].generation == generation) {
+        dtor = tss_keys[index].dtor;
+    }
 
-int mtx_trylock(mtx_t *mutex) {
-    int err = pthread_mutex_trylock(mutex);
+    err = pthread_mutex_unlock(&tss_keys_mutex);
     if (err) {
-        if (err == EBUSY) {
-            return thrd_busy;
-        } else {
-            printf("[threads_macos_compat] pthread_mutex_trylock error: %d %s\n", err, strerror(err));
-        }
+        report_error("tss destructor pthread_mutex_unlock", err);
     }
 
-    return err ? thrd_error : thrd_success;
+    return dtor;
 }
 
-static inline bool timespec_is_greater_than(const struct timespec *a, const struct timespec *b) {
-    if (a->tv_sec > b->tv_sec) {
-        return true;
+static void tss_run_destructors(threads_compat_tss_block_t *block) {
+    for (int iteration = 0; iteration < TSS_DTOR_ITERATIONS; iteration++) {
+        bool called = false;
+
+        for (unsigned int i = 0; i < THREADS_COMPAT_TSS_MAX; i++) {
+            void *value = block->slots[i].value;
+            if (!value) {
+                continue;
+            }
+
+            tss_dtor_t dtor = tss_get_dtor(i, block->slots[i].generation);
+            if (!dtor) {
+                continue;
+            }
+
+            // C11 requires the value to be NULL before the destructor is called
+            block->slots[i].value = NULL;
+            dtor(value);
+            called = true;
+        }
+
+        if (!called) {
+            break;
+        }
     }
+}
 
-    if (a->tv_sec < b->tv_sec) {
-        return false;
+static void tss_destroy_block(void *arg) {
+    // the block is passed in by pthread, so we do not depend on thread-local storage still being available while
+    // pthread key destructors are being run
+    threads_compat_tss_block_t *block = arg;
+
+    tss_run_destructors(block);
+
+    if (threads_compat_tss_block == block) {
+        threads_compat_tss_block = NULL;
     }
 
-    return a->tv_nsec > b->tv_nsec;
+    free(block);
 }
 
-int mtx_timedlock(mtx_t *mutex, const struct timespec *time_point) {
-    // macOS does not have pthread_mutex_timedlock, so unfortunately we need to work around it
+#ifdef THREADS_COMPAT_THREAD_CACHE
+static void tss_reset_thread() {
+    // cached threads are reused for other functions which, to C11, are new threads
+    threads_compat_tss_block_t *block = threads_compat_tss_block;
+    if (!block) {
+        return;
+    }
 
-    int res = 0;
-    struct timespec now = {0};
-    struct timespec remaining = {0};
-    struct timespec sleep_time = {
-        .tv_sec = THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_FULL_SECONDS,
-        .tv_nsec = THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOSECOND_PART,
-    };
+    tss_run_destructors(block);
+    memset(block, 0, sizeof(threads_compat_tss_block_t));
+}
+#endif
 
-    struct timespec latest_full_sleep_start = {
-        .tv_sec = time_point->tv_sec - THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_FULL_SECONDS,
-        .tv_nsec = time_point->tv_sec - THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOSECOND_PART,
-    };
-    if (latest_full_sleep_start.tv_nsec < 0) {
-        latest_full_sleep_start.tv_sec--;
-        latest_full_sleep_start.tv_nsec += THREADS_COMPAT_NANOS_PER_SECOND;
+static void tss_create_block_key() {
+    tss_block_key_err = pthread_key_create(&tss_block_key, tss_destroy_block);
+}
+
+static threads_compat_tss_block_t* tss_create_block() {
+    int err = pthread_once(&tss_block_key_once, tss_create_block_key);
+    if (err || tss_block_key_err) {
+        err = err ? err : tss_block_key_err;
+        report_error("tss pthread_key_create", err);
+        return NULL;
     }
-    if (latest_full_sleep_start.tv_nsec < 0) {
-        printf("[threads_macos_compat] mtx_timedlock calculated negative nanoseconds for latest full sleep\n");
-        return thrd_error;
+
+    threads_compat_tss_block_t *block = calloc(1, sizeof(threads_compat_tss_block_t));
+    if (!block) {
+        report_error("tss_set out of memory?", ENOMEM);
+        return NULL;
     }
-    if (latest_full_sleep_start.tv_sec < 0) {
-        printf("[threads_macos_compat] mtx_timedlock calculated negative seconds for latest full sleep\n");
-        return thrd_error;
+
+    err = pthread_setspecific(tss_block_key, block);
+    if (err) {
+        report_error("tss pthread_setspecific", err);
+        free(block);
+        return NULL;
     }
 
-    while (true) {
-        res = pthread_mutex_trylock(mutex);
-        if (!res) {
+    threads_compat_tss_block = block;
+
+    return block;
+}
+
+int tss_set(tss_t key, void *val) {
+    threads_compat_tss_block_t *block = threads_compat_tss_block;
+    if (!block) {
+        if (!val) {
+            // nothing to store, tss_get already yields NULL without a block
             return thrd_success;
         }
 
-        if (res != EBUSY) {
-            printf("[threads_macos_compat] mtx_timedlock/pthread_mutex_trylock error: %d %s\n", res, strerror(res));
+        block = tss_create_block();
+        if (!block) {
             return thrd_error;
         }
+    }
 
-        res = timespec_get(&now, TIME_UTC);
-        if (!res) {
-            printf("[threads_macos_compat] mtx_timedlock/timespec_get failed\n");
-            return thrd_error;
+    block->slots[key.index].value = val;
+    block->slots[key.index].generation = key.generation;
+
+    return thrd_success;
+}
+
+#define ONCE_STATE_INITIAL 0
+#define ONCE_STATE_RUNNING 1
+#define ONCE_STATE_WAITING 2
+#define ONCE_STATE_DONE THREADS_COMPAT_ONCE_DONE
+
+// initialization is rare, so all once flags share the same mutex and condition to block on
+static pthread_mutex_t once_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t once_cond = PTHREAD_COND_INITIALIZER;
+
+void threads_compat_call_once_slow(once_flag *flag, void (*func)(void)) {
+    unsigned int state = ONCE_STATE_INITIAL;
+    if (atomic_compare_exchange_strong_explicit(&flag->state, &state, ONCE_STATE_RUNNING, memory_order_acquire, memory_order_acquire)) {
+        func();
+
+        // other threads only indicate that they need to be woken while holding the mutex, so we only need to lock it
+        // if someone actually waits
+        state = atomic_exchange_explicit(&flag->state, ONCE_STATE_DONE, memory_order_acq_rel);
+        if (state != ONCE_STATE_WAITING) {
+            return;
         }
 
-        if (timespec_is_greater_than(&now, time_point)) {
-            return thrd_timedout;
+        int err = pthread_mutex_lock(&once_mutex);
+        if (err) {
+            report_error("call_once pthread_mutex_lock", err);
+            return;
         }
 
-        if (!timespec_is_greater_than(&now, &latest_full_sleep_start)) {
-            // there's enough time for at least one regular check interval to sleep for
-            // this reset should usually not be needed but it's safer to restore original behaviour just in case
-            // the real-time clock rolls back after we already reached the presumed last sleep cycle
-            sleep_time.tv_sec = THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_FULL_SECONDS;
-            sleep_time.tv_nsec = THREADS_COMPAT_TIMED_LOCK_CHECK_INTERVAL_NANOSECOND_PART;
-        } else {
-            // we have less time to remain for sleeping than the regular check interval, calculate time remaining until
-            // time_point is reached
-            sleep_time.tv_sec = time_point->tv_sec - now.tv_sec;
-            sleep_time.tv_nsec = time_point->tv_nsec - now.tv_nsec;
-            if (sleep_time.tv_nsec < 0) {
-                sleep_time.tv_sec--;
-                sleep_time.tv_nsec += THREADS_COMPAT_NANOS_PER_SECOND;
-            }
-            if (sleep_time.tv_nsec < 0) {
-                printf("[threads_macos_compat] mtx_timedlock calculated negative nanoseconds for last sleep\n");
-                return thrd_error;
-            }
-            if (sleep_time.tv_sec < 0) {
-                printf("[threads_macos_compat] mtx_timedlock calculated negative seconds for last sleep\n");
-                return thrd_error;
-            }
+        err = pthread_cond_broadcast(&once_cond);
+        if (err) {
+            report_error("call_once pthread_cond_broadcast", err);
+        }
+
+        err = pthread_mutex_unlock(&once_mutex);
+        if (err) {
+            report_error("call_once pthread_mutex_unlock", err);
+        }
+
+        return;
+    }
+
+    if (state == ONCE_STATE_DONE) {
+        return;
+    }
+
+    int err = pthread_mutex_lock(&once_mutex);
+    if (err) {
+        report_error("call_once pthread_mutex_lock", err);
+        return;
+    }
+
+    while ((state = atomic_load_explicit(&flag->state, memory_order_acquire)) != ONCE_STATE_DONE) {
+        if (state == ONCE_STATE_RUNNING && !atomic_compare_exchange_strong_explicit(&flag->state, &state, ONCE_STATE_WAITING, memory_order_acquire, memory_order_acquire)) {
+            // state changed, check again
+            continue;
+        }
+
+        err = pthread_cond_wait(&once_cond, &once_mutex);
+        if (err) {
+            report_error("call_once pthread_cond_wait", err);
+            break;
         }
+    }
+
+    err = pthread_mutex_unlock(&once_mutex);
+    if (err) {
+        report_error("call_once pthread_mutex_unlock", err);
+    }
+}
+
+// Errors are reported to a handler which can be set by the application. By default they are queued to a lock-free
+// ring buffer (bounded MPMC queue using sequence numbers) which can be drained by threads_compat_fetch_errors. Errors
+// are dropped if the buffer is full, so reporting never blocks.
+static struct {
+    // stored relative to the slot index, so the zero-initialized buffer is already in its initial state
+    atomic_size_t sequence;
+    threads_compat_error_t error;
+} error_buffer[THREADS_COMPAT_ERROR_BUFFER_SIZE];
 
-        if (!(sleep_time.tv_sec || sleep_time.tv_nsec)) {
-            // we somehow ended up at zero sleep time, just yield thread and retry
-            sched_yield();
+static atomic_size_t error_buffer_write_pos = 0;
+static atomic_size_t error_buffer_read_pos = 0;
+static atomic_ulong error_buffer_dropped = 0;
+static _Atomic(threads_compat_error_handler_t) error_handler = NULL;
+
+static void error_buffer_push(const threads_compat_error_t *error) {
+    size_t pos = atomic_load_explicit(&error_buffer_write_pos, memory_order_relaxed);
+    while (true) {
+        size_t index = pos & (THREADS_COMPAT_ERROR_BUFFER_SIZE - 1);
+        size_t sequence = atomic_load_explicit(&error_buffer[index].sequence, memory_order_acquire) + index;
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&error_buffer_write_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                error_buffer[index].error = *error;
+                atomic_store_explicit(&error_buffer[index].sequence, pos + 1 - index, memory_order_release);
+                return;
+            }
+        } else if (diff < 0) {
+            // full
+            atomic_fetch_add_explicit(&error_buffer_dropped, 1, memory_order_relaxed);
+            return;
         } else {
-            res = nanosleep(&sleep_time, &remaining);
-            if (res) {
-                printf("[threads_macos_compat] mtx_timedlock/nanosleep error: %d %s\n", res, strerror(res));
-                return thrd_error;
+            pos = atomic_load_explicit(&error_buffer_write_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool error_buffer_pop(threads_compat_error_t *error) {
+    size_t pos = atomic_load_explicit(&error_buffer_read_pos, memory_order_relaxed);
+    while (true) {
+        size_t index = pos & (THREADS_COMPAT_ERROR_BUFFER_SIZE - 1);
+        size_t sequence = atomic_load_explicit(&error_buffer[index].sequence, memory_order_acquire) + index;
+        intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&error_buffer_read_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *error = error_buffer[index].error;
+                atomic_store_explicit(&error_buffer[index].sequence, pos + THREADS_COMPAT_ERROR_BUFFER_SIZE - index, memory_order_release);
+                return true;
             }
+        } else if (diff < 0) {
+            // empty
+            return false;
+        } else {
+            pos = atomic_load_explicit(&error_buffer_read_pos, memory_order_relaxed);
         }
     }
 }
 
-int mtx_unlock(mtx_t *mutex) {
-    int err = pthread_mutex_unlock(mutex);
-    if (err) {
-        printf("[threads_macos_compat] pthread_mutex_unlock error: %d %s\n", err, strerror(err));
+void threads_compat_report_error(const char *site, int err) {
+    threads_compat_error_t error = {
+        .err = err,
+        .site = site,
+        .thread = pthread_self(),
+    };
+
+    threads_compat_error_handler_t handler = atomic_load_explicit(&error_handler, memory_order_acquire);
+    if (handler) {
+        handler(&error);
+    } else {
+        error_buffer_push(&error);
     }
+}
 
-    return err ? thrd_error : thrd_success;
+void threads_compat_set_error_handler(threads_compat_error_handler_t handler) {
+    atomic_store_explicit(&error_handler, handler, memory_order_release);
 }
 
-typedef struct {
-    thrd_start_t actual_func;
-    void *actual_arg;
-    int res;
-} wrapped_thread_t;
+size_t threads_compat_fetch_errors(threads_compat_error_t *errors, size_t max_errors) {
+    size_t num_errors = 0;
+    while (num_errors < max_errors && error_buffer_pop(&errors[num_errors])) {
+        num_errors++;
+    }
 
-static void* wrap_thread_func(void *arg) {
-    wrapped_thread_t *wrapped = arg;
-    wrapped->res = wrapped->actual_func(wrapped->actual_arg);
-    return arg;
+    return num_errors;
 }
 
-static void* zmalloc(size_t size) {
-    // prevent zero allocation requests as some malloc implementations may corrupt in that case
-    if (size == 0) {
-        return NULL;
+unsigned long threads_compat_dropped_errors() {
+    return atomic_load_explicit(&error_buffer_dropped, memory_order_relaxed);
+}
+
+void threads_compat_print_error(const threads_compat_error_t *error) {
+    if (error->err) {
+        printf("[threads_macos_compat] %s error: %d %s\n", error->site, error->err, strerror(error->err));
+    } else {
+        printf("[threads_macos_compat] %s\n", error->site);
     }
+}
 
-    void *addr = malloc(size);
-    if (addr) {
-        memset(addr, 0, size);
+#ifdef THREADS_COMPAT_MTX_PROFILING
+static void mtx_stats_snapshot(const threads_compat_mtx_profile_t *profile, threads_compat_mtx_stats_t *stats) {
+    // the profile is embedded in the mutex, so its address leads back to the mutex
+    stats->mutex = (const mtx_t*) ((const char*) profile - offsetof(mtx_t, profile));
+    stats->name = profile->name;
+    stats->acquisitions = atomic_load_explicit(&profile->acquisitions, memory_order_relaxed);
+    stats->contended = atomic_load_explicit(&profile->contended, memory_order_relaxed);
+    stats->busy = atomic_load_explicit(&profile->busy, memory_order_relaxed);
+    stats->wait_nanos_total = atomic_load_explicit(&profile->wait_nanos_total, memory_order_relaxed);
+    stats->wait_nanos_max = atomic_load_explicit(&profile->wait_nanos_max, memory_order_relaxed);
+    for (unsigned int i = 0; i < THREADS_COMPAT_MTX_HOLD_BUCKETS; i++) {
+        stats->hold_histogram[i] = atomic_load_explicit(&profile->hold_histogram[i], memory_order_relaxed);
     }
-    return addr;
 }
+#endif
 
-int thrd_create(thrd_t *thr, thrd_start_t func, void *arg) {
-    wrapped_thread_t *wrapped = zmalloc(sizeof(wrapped_thread_t));
-    if (!wrapped) {
-        printf("[threads_macos_compat] thrd_create out of memory?\n");
-        return thrd_error;
+void threads_compat_mtx_stats_foreach(threads_compat_mtx_stats_callback_t callback, void *context) {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    int err = pthread_mutex_lock(&mtx_profile_registry_mutex);
+    if (err) {
+        report_error("mtx profiling registry pthread_mutex_lock", err);
+        return;
     }
 
-    wrapped->actual_func = func;
-    wrapped->actual_arg = arg;
+    threads_compat_mtx_stats_t stats = {0};
+    for (threads_compat_mtx_profile_t *profile = mtx_profile_registry; profile; profile = profile->next) {
+        mtx_stats_snapshot(profile, &stats);
+        callback(&stats, context);
+    }
 
-    int err = pthread_create(thr, NULL, wrap_thread_func, wrapped);
+    err = pthread_mutex_unlock(&mtx_profile_registry_mutex);
     if (err) {
-        printf("[threads_macos_compat] pthread_create error: %d %s\n", err, strerror(err));
-        free(wrapped);
+        report_error("mtx profiling registry pthread_mutex_unlock", err);
     }
+#else
+    (void) callback;
+    (void) context;
+#endif
+}
 
-    return err ? thrd_error : thrd_success;
+static void mtx_stats_print(const threads_compat_mtx_stats_t *stats, void *context) {
+    FILE *out = context;
+
+    fprintf(out, "[threads_macos_compat] mtx %p %s: acquisitions=%llu contended=%llu busy=%llu wait_ns_total=%llu wait_ns_max=%llu hold_ns_log2=",
+            (const void*) stats->mutex, stats->name ? stats->name : "-", stats->acquisitions, stats->contended,
+            stats->busy, stats->wait_nanos_total, stats->wait_nanos_max);
+
+    // only non-empty buckets as <log2>:<count>
+    bool first = true;
+    for (unsigned int i = 0; i < THREADS_COMPAT_MTX_HOLD_BUCKETS; i++) {
+        if (stats->hold_histogram[i]) {
+            fprintf(out, "%s%u:%llu", first ? "" : ",", i, stats->hold_histogram[i]);
+            first = false;
+        }
+    }
+
+    fprintf(out, "\n");
 }
 
-int thrd_sleep(const struct timespec *duration, struct timespec *remaining) {
-    return nanosleep(duration, remaining);
+void threads_compat_mtx_stats_dump(FILE *out) {
+    threads_compat_mtx_stats_foreach(mtx_stats_print, out);
 }
 
-int thrd_join(thrd_t thr, int *res) {
-    wrapped_thread_t *wrapped = NULL;
-    int err = pthread_join(thr, (void**) &wrapped);
+void threads_compat_mtx_stats_reset() {
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    int err = pthread_mutex_lock(&mtx_profile_registry_mutex);
     if (err) {
-        printf("[threads_macos_compat] pthread_join error: %d %s\n", err, strerror(err));
-        return thrd_error;
+        report_error("mtx profiling registry pthread_mutex_lock", err);
+        return;
     }
 
-    if (!wrapped) {
-        printf("[threads_macos_compat] joined thread returned NULL (not our wrapper?!)\n");
-
-        if (res) {
-            *res = 0;
-        }
-    } else {
-        if (res) {
-            *res = wrapped->res;
+    // counters are only reset racily against concurrent lock holders, so some in-flight updates may survive
+    for (threads_compat_mtx_profile_t *profile = mtx_profile_registry; profile; profile = profile->next) {
+        atomic_store_explicit(&profile->acquisitions, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->contended, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->busy, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->wait_nanos_total, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->wait_nanos_max, 0, memory_order_relaxed);
+        for (unsigned int i = 0; i < THREADS_COMPAT_MTX_HOLD_BUCKETS; i++) {
+            atomic_store_explicit(&profile->hold_histogram[i], 0, memory_order_relaxed);
         }
+    }
 
-        free(wrapped);
+    err = pthread_mutex_unlock(&mtx_profile_registry_mutex);
+    if (err) {
+        report_error("mtx profiling registry pthread_mutex_unlock", err);
     }
+#endif
+}
 
-    return thrd_success;
+#if defined(THREADS_COMPAT_TRACING) && !defined(THREADS_COMPAT_USE_TRACE_BUFFER)
+static pthread_once_t trace_log_once = PTHREAD_ONCE_INIT;
+static os_log_t trace_log_handle;
+
+static void trace_log_init() {
+    // points of interest are shown by Instruments without any further configuration
+    trace_log_handle = os_log_create(THREADS_COMPAT_TRACE_SUBSYSTEM, OS_LOG_CATEGORY_POINTS_OF_INTEREST);
 }
 
-void inline thrd_yield() {
-    sched_yield();
+static os_log_t trace_log() {
+    pthread_once(&trace_log_once, trace_log_init);
+    return trace_log_handle;
 }
+#endif
 
-int cnd_init(cnd_t *cond) {
-    int err = pthread_cond_init(cond, NULL);
-    if (err) {
-        printf("[threads_macos_compat] pthread_cond_init error: %d %s\n", err, strerror(err));
-        return (err == ENOMEM) ? thrd_nomem : thrd_error;
-    }
+#ifdef THREADS_COMPAT_USE_TRACE_BUFFER
+typedef struct {
+    // set last (release) once all other fields have been written
+    atomic_bool complete;
 
-    return thrd_success;
+    const char *name;
+    const void *object;
+    unsigned int thread;
+    unsigned long long start_nanos;
+    unsigned long long duration_nanos;
+} trace_event_t;
+
+static trace_event_t trace_buffer[THREADS_COMPAT_TRACE_BUFFER_SIZE];
+static atomic_size_t trace_buffer_next = 0;
+static atomic_ulong trace_buffer_dropped = 0;
+
+// threads are numbered in order of their first traced call, 0 means not numbered yet
+static atomic_uint trace_thread_count = 0;
+static _Thread_local unsigned int trace_thread = 0;
+
+static unsigned long long trace_now() {
+    return clock_now_nanos();
 }
 
-void cnd_destroy(cnd_t *cond) {
-    int err = pthread_cond_destroy(cond);
-    if (err) {
-        printf("[threads_macos_compat] pthread_cond_destroy error: %d %s\n", err, strerror(err));
+static void trace_record(const trace_span_t *span) {
+    unsigned long long end_nanos = trace_now();
+
+    if (!trace_thread) {
+        trace_thread = atomic_fetch_add_explicit(&trace_thread_count, 1, memory_order_relaxed) + 1;
     }
-}
 
-int cnd_wait(cnd_t *cond, mtx_t *mutex) {
-    int err = pthread_cond_wait(cond, mutex);
-    if (err) {
-        printf("[threads_macos_compat] pthread_cond_wait error: %d %s\n", err, strerror(err));
-        return thrd_error;
+    // the index keeps growing after the buffer is full, so recording never needs more than one atomic operation
+    size_t index = atomic_fetch_add_explicit(&trace_buffer_next, 1, memory_order_relaxed);
+    if (index >= THREADS_COMPAT_TRACE_BUFFER_SIZE) {
+        atomic_fetch_add_explicit(&trace_buffer_dropped, 1, memory_order_relaxed);
+        return;
     }
-    
-    return thrd_success;
+
+    trace_event_t *event = &trace_buffer[index];
+    event->name = span->name;
+    event->object = span->object;
+    event->thread = trace_thread;
+    event->start_nanos = span->start_nanos;
+    event->duration_nanos = end_nanos - span->start_nanos;
+    atomic_store_explicit(&event->complete, true, memory_order_release);
 }
+#endif
 
-int cnd_broadcast(cnd_t *cond) {
-    int err = pthread_cond_broadcast(cond);
-    if (err) {
-        printf("[threads_macos_compat] pthread_cond_broadcast error: %d %s\n", err, strerror(err));
-        return thrd_error;
+size_t threads_compat_trace_export(FILE *out) {
+    size_t num_events = 0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+#ifdef THREADS_COMPAT_USE_TRACE_BUFFER
+    size_t end = atomic_load_explicit(&trace_buffer_next, memory_order_relaxed);
+    if (end > THREADS_COMPAT_TRACE_BUFFER_SIZE) {
+        end = THREADS_COMPAT_TRACE_BUFFER_SIZE;
     }
 
-    return thrd_success;
+    // timestamps are microseconds of the shared clock (fractions provide nanosecond resolution)
+    for (size_t i = 0; i < end; i++) {
+        const trace_event_t *event = &trace_buffer[i];
+        if (!atomic_load_explicit(&event->complete, memory_order_acquire)) {
+            // still being recorded
+            continue;
+        }
+
+        fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"threads_compat\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%u,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"args\":{\"object\":\"%p\"}}",
+                num_events ? "," : "", event->name, (long) getpid(), event->thread,
+                event->start_nanos / 1000, event->start_nanos % 1000,
+                event->duration_nanos / 1000, event->duration_nanos % 1000,
+                event->object);
+        num_events++;
+    }
+#endif
+
+    fprintf(out, "\n]}\n");
+
+    return num_events;
 }
 
-int cnd_timedwait(cnd_t *cond, mtx_t *mutex, const struct timespec *time_point) {
-    // FIXME: C11 time_point should be UTC-based but POSIX threads do not specify any time zone ("system time"?)
-    int err = pthread_cond_timedwait(cond, mutex, time_point);
-    if (err) {
-        if (err == ETIMEDOUT) {
-            return thrd_timedout;
-        }
+void threads_compat_trace_reset() {
+#ifdef THREADS_COMPAT_USE_TRACE_BUFFER
+    size_t end = atomic_load_explicit(&trace_buffer_next, memory_order_relaxed);
+    if (end > THREADS_COMPAT_TRACE_BUFFER_SIZE) {
+        end = THREADS_COMPAT_TRACE_BUFFER_SIZE;
+    }
 
-        printf("[threads_macos_compat] pthread_cond_timedwait error: %d %s\n", err, strerror(err));
-        return thrd_error;
+    for (size_t i = 0; i < end; i++) {
+        atomic_store_explicit(&trace_buffer[i].complete, false, memory_order_relaxed);
     }
-    
-    return thrd_success;
+
+    atomic_store_explicit(&trace_buffer_dropped, 0, memory_order_relaxed);
+    atomic_store_explicit(&trace_buffer_next, 0, memory_order_release);
+#endif
+}
+
+unsigned long threads_compat_trace_dropped() {
+#ifdef THREADS_COMPAT_USE_TRACE_BUFFER
+    return atomic_load_explicit(&trace_buffer_dropped, memory_order_relaxed);
+#else
+    return 0;
+#endif
 }
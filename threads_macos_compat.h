@@ -46,39 +46,575 @@
 
 #define THREADS_MACOS_COMPAT_H
 
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
-typedef pthread_mutex_t mtx_t;
+#if defined(THREADS_COMPAT_UNFAIR_LOCK) && defined(__APPLE__) && !defined(THREADS_COMPAT_ADDR_WAIT)
+#define THREADS_COMPAT_USE_UNFAIR_LOCK
+#include <os/lock.h>
+#endif
+
+// outside macOS, condition variables need to be initialized for CLOCK_MONOTONIC at runtime, so static initializers
+// leave them to be initialized on first use
+#if !defined(THREADS_COMPAT_ADDR_WAIT) && !defined(__APPLE__)
+#define THREADS_COMPAT_USE_LAZY_COND
+#endif
+
+// instrumented builds always call out of line
+#if defined(THREADS_MACOS_COMPAT_INLINE) && !defined(THREADS_COMPAT_MTX_PROFILING) && !defined(THREADS_COMPAT_TRACING)
+#define THREADS_COMPAT_USE_INLINE
+#endif
+
+#define mtx_plain (1 << 0)
+#define mtx_recursive (1 << 1)
+#define mtx_timed (1 << 2)
+
+// extension: owners inherit the priority of threads blocked on the mutex (PTHREAD_PRIO_INHERIT), can be combined with
+// all other types; not supported with THREADS_COMPAT_ADDR_WAIT
+#define mtx_prio_inherit (1 << 3)
+
+#define THREADS_COMPAT_MTX_HOLD_BUCKETS (32)
+
+// defaults of mtx_set_spin for all mutexes, also used by the static initializers
+#ifndef THREADS_COMPAT_MTX_SPIN_COUNT
+#define THREADS_COMPAT_MTX_SPIN_COUNT 0 /* default to block immediately */
+#endif
+
+#ifndef THREADS_COMPAT_MTX_SPIN_BACKOFF_MAX
+#define THREADS_COMPAT_MTX_SPIN_BACKOFF_MAX 64
+#endif
+
+#ifdef THREADS_COMPAT_MTX_PROFILING
+// per-mutex statistics, counters are only written while holding the mutex (except busy) but may be read at any time
+typedef struct threads_compat_mtx_profile {
+    // registry of all initialized mutexes, guarded by the registry lock; statically initialized mutexes are only
+    // registered once acquired
+    struct threads_compat_mtx_profile *prev;
+    struct threads_compat_mtx_profile *next;
+    atomic_bool registered;
+
+    const char *name;
+
+    atomic_ullong acquisitions;
+    atomic_ullong contended;
+    atomic_ullong busy;
+    atomic_ullong wait_nanos_total;
+    atomic_ullong wait_nanos_max;
+    atomic_ullong hold_histogram[THREADS_COMPAT_MTX_HOLD_BUCKETS];
+
+    // owner state, only accessed while holding the mutex
+    unsigned long long acquired_at;
+    unsigned int depth;
+} threads_compat_mtx_profile_t;
+#endif
+
+#ifdef THREADS_COMPAT_ADDR_WAIT
+// record of a thread waiting on a cnd_t, only used internally
+struct threads_compat_cnd_waiter;
+
+// waits by address (see addr_wait) instead of using pthreads
+typedef struct {
+    // 0 unlocked, 1 locked, 2 locked and other threads may be waiting
+    atomic_uint state;
+    int type;
+
+    // adaptive spinning before blocking, see mtx_set_spin
+    unsigned int spin_count;
+    unsigned int spin_backoff_max;
+
+    // only used for mtx_recursive and mtx_timed, identifies the owning thread by a thread-local address
+    atomic_uintptr_t owner;
+    unsigned int lock_count;
+
+    // condition waiters moved over by cnd_broadcast, woken one at a time by releasing the mutex; only changed while
+    // holding the mutex
+    struct threads_compat_cnd_waiter *handoff_head;
+    struct threads_compat_cnd_waiter *handoff_tail;
+
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    threads_compat_mtx_profile_t profile;
+#endif
+} mtx_t;
+#else
+// lock state of mtx_timed without mtx_prio_inherit, only used internally
+struct threads_compat_mtx_timed;
+
+typedef struct {
+    // only one representation is used, depending on type
+    union {
+        pthread_mutex_t mutex;
+
+        // mtx_timed without mtx_prio_inherit: lock state incl. the mutex guarding it and the condition waiters block
+        // on, allocated by mtx_init (or on first use if statically initialized) so other mutexes stay small
+        _Atomic(struct threads_compat_mtx_timed *) timed;
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+        // replaces mutex for mtx_plain (also with mtx_prio_inherit, os_unfair_lock donates priority to its owner)
+        os_unfair_lock unfair;
+#endif
+    };
+
+    int type;
+
+    // adaptive spinning before blocking, see mtx_set_spin
+    unsigned int spin_count;
+    unsigned int spin_backoff_max;
+
+#ifdef THREADS_COMPAT_MTX_PROFILING
+    threads_compat_mtx_profile_t profile;
+#endif
+} mtx_t;
+#endif
+
+#ifdef THREADS_COMPAT_THREAD_CACHE
+// threads may be reused, so they are identified by the record of the function they run
+typedef struct threads_compat_thread *thrd_t;
+#else
 typedef pthread_t thrd_t;
-typedef pthread_cond_t cnd_t;
+#endif
+
+#ifdef THREADS_COMPAT_ADDR_WAIT
+typedef struct {
+    // guards the list of waiting threads; 0 unlocked, 1 locked, 2 locked and other threads may be waiting
+    atomic_uint guard;
+
+    // threads currently in cnd_wait/cnd_timedwait, allows to skip signalling if nobody is waiting
+    atomic_uint waiters;
+
+    struct threads_compat_cnd_waiter *head;
+    struct threads_compat_cnd_waiter *tail;
+} cnd_t;
+#else
+typedef struct {
+    pthread_cond_t cond;
+
+    // threads currently in cnd_wait/cnd_timedwait, allows to skip signalling if nobody is waiting
+    atomic_uint waiters;
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    // os_unfair_lock cannot be waited on by pthread_cond_wait, so waiters and signalling have to synchronize on guard
+    pthread_mutex_t guard;
+#endif
+
+#ifdef THREADS_COMPAT_USE_LAZY_COND
+    // false until cond has been initialized, see THREADS_COMPAT_USE_LAZY_COND
+    atomic_bool cond_initialized;
+#endif
+} cnd_t;
+#endif
+
+// extension: static initializers equivalent to mtx_init with the respective type or cnd_init, e.g. for global tables
+// of locks; mtx_prio_inherit always requires mtx_init. Statically initialized objects still need to be destroyed if
+// they are no longer used during runtime.
+#ifdef THREADS_COMPAT_ADDR_WAIT
+#define THREADS_COMPAT_MTX_INIT_FIELDS(mtx_type) \
+    .type = (mtx_type), \
+    .spin_count = THREADS_COMPAT_MTX_SPIN_COUNT, \
+    .spin_backoff_max = THREADS_COMPAT_MTX_SPIN_BACKOFF_MAX
+
+#define MTX_PLAIN_INIT {.state = 0, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_plain)}
+#define MTX_RECURSIVE_INIT {.state = 0, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_plain | mtx_recursive)}
+#define MTX_TIMED_INIT {.state = 0, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_timed)}
+#define MTX_TIMED_RECURSIVE_INIT {.state = 0, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_timed | mtx_recursive)}
+#define CND_INIT {.guard = 0}
+#else
+#ifdef THREADS_COMPAT_USE_LAZY_COND
+#define THREADS_COMPAT_CND_INIT_COND
+#else
+#define THREADS_COMPAT_CND_INIT_COND .cond = PTHREAD_COND_INITIALIZER,
+#endif
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+#define THREADS_COMPAT_CND_INIT_GUARD , .guard = PTHREAD_MUTEX_INITIALIZER
+#else
+#define THREADS_COMPAT_CND_INIT_GUARD
+#endif
+
+#define THREADS_COMPAT_MTX_INIT_FIELDS(mtx_type) \
+    .type = (mtx_type), \
+    .spin_count = THREADS_COMPAT_MTX_SPIN_COUNT, \
+    .spin_backoff_max = THREADS_COMPAT_MTX_SPIN_BACKOFF_MAX
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+// OS_UNFAIR_LOCK_INIT is a compound literal which is not a constant expression in static initializers
+#define MTX_PLAIN_INIT {.unfair = {0}, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_plain)}
+#else
+#define MTX_PLAIN_INIT {.mutex = PTHREAD_MUTEX_INITIALIZER, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_plain)}
+#endif
+
+// the lock state of timed mutexes is only allocated on first use
+#define MTX_TIMED_INIT {.timed = NULL, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_timed)}
+#define MTX_TIMED_RECURSIVE_INIT {.timed = NULL, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_timed | mtx_recursive)}
+#define CND_INIT {THREADS_COMPAT_CND_INIT_COND .waiters = 0 THREADS_COMPAT_CND_INIT_GUARD}
+
+// only provided if the system has a static initializer for recursive mutexes (glibc only as non-portable extension)
+#if defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER)
+#define MTX_RECURSIVE_INIT {.mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_plain | mtx_recursive)}
+#elif defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP)
+#define MTX_RECURSIVE_INIT {.mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, THREADS_COMPAT_MTX_INIT_FIELDS(mtx_plain | mtx_recursive)}
+#endif
+#endif
+
+// size of cache lines to separate objects used by different threads by, Apple Silicon uses 128 bytes
+#ifndef THREADS_COMPAT_CACHE_LINE_SIZE
+#if defined(__APPLE__) && defined(__aarch64__)
+#define THREADS_COMPAT_CACHE_LINE_SIZE (128)
+#else
+#define THREADS_COMPAT_CACHE_LINE_SIZE (64)
+#endif
+#endif
+
+// extension: mutex and condition padded to occupy whole cache lines, so arrays of them do not share lines between
+// neighbouring objects; the regular functions are called on the members, dynamic allocations need to be aligned to
+// THREADS_COMPAT_CACHE_LINE_SIZE (e.g. by aligned_alloc)
+typedef struct {
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) mtx_t mutex;
+} mtx_padded_t;
+
+typedef struct {
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) cnd_t cond;
+} cnd_padded_t;
 
 typedef int (*thrd_start_t)(void*);
 
+#define thrd_qos_unspecified (0)
+#define thrd_qos_background (1)
+#define thrd_qos_utility (2)
+#define thrd_qos_default (3)
+#define thrd_qos_user_initiated (4)
+#define thrd_qos_user_interactive (5)
+
+// extension: attributes for thrd_create_ex, zero-initialized attributes are equivalent to thrd_create
+typedef struct {
+    // 0 for system default, otherwise rounded up to page size
+    size_t stack_size;
+
+    // one of thrd_qos_*, only supported by macOS
+    int qos_class;
+
+    // offset within the QoS class, 0 (default) down to -15
+    int relative_priority;
+} thrd_attr_t;
+
+#ifndef THREADS_COMPAT_TSS_MAX
+#define THREADS_COMPAT_TSS_MAX (64)
+#endif
+
+#define TSS_DTOR_ITERATIONS (4)
+
+typedef void (*tss_dtor_t)(void*);
+
+typedef struct {
+    unsigned int index;
+    unsigned int generation;
+} tss_t;
+
+// values are held per thread in a block which is only allocated on first tss_set; the block is registered to a
+// single pthread key to run destructors on thread exit
+typedef struct {
+    struct {
+        void *value;
+        unsigned int generation;
+    } slots[THREADS_COMPAT_TSS_MAX];
+} threads_compat_tss_block_t;
+
+extern _Thread_local threads_compat_tss_block_t *threads_compat_tss_block;
+
+typedef struct {
+    atomic_uint state;
+} once_flag;
+
+#define ONCE_FLAG_INIT {0}
+
+// once_flag state after initialization has completed
+#define THREADS_COMPAT_ONCE_DONE (3)
+
+// extension: error reporting
+typedef struct {
+    // error number, 0 if not applicable
+    int err;
+
+    // static description of what failed
+    const char *site;
+
+    pthread_t thread;
+} threads_compat_error_t;
+
+typedef void (*threads_compat_error_handler_t)(const threads_compat_error_t *error);
+
+// extension: snapshot of mutex statistics, only collected if THREADS_COMPAT_MTX_PROFILING is defined
+typedef struct {
+    const mtx_t *mutex;
+
+    // as set by mtx_set_name, NULL if unnamed
+    const char *name;
+
+    // successful locks, including relocking after a condition wait
+    unsigned long long acquisitions;
+
+    // acquisitions which had to wait because the mutex was held by another thread
+    unsigned long long contended;
+
+    // mtx_trylock calls which failed and mtx_timedlock calls which timed out
+    unsigned long long busy;
+
+    // time spent waiting for contended acquisitions
+    unsigned long long wait_nanos_total;
+    unsigned long long wait_nanos_max;
+
+    // bucket i counts hold times of less than 2^(i+1) nanoseconds (but at least 2^i for i > 0), the last bucket also
+    // counts everything longer
+    unsigned long long hold_histogram[THREADS_COMPAT_MTX_HOLD_BUCKETS];
+} threads_compat_mtx_stats_t;
+
+typedef void (*threads_compat_mtx_stats_callback_t)(const threads_compat_mtx_stats_t *stats, void *context);
+
 #define thrd_success (0)
 #define thrd_error (1)
 #define thrd_nomem (2)
 #define thrd_timedout (3)
 #define thrd_busy (4)
 
-#define mtx_plain (1 << 0)
-#define mtx_recursive (1 << 1)
-
 int mtx_init(mtx_t *mutex, int type);
 void mtx_destroy(mtx_t *mutex);
+int mtx_timedlock(mtx_t *mutex, const struct timespec *time_point);
+#ifndef THREADS_COMPAT_USE_INLINE
 int mtx_lock(mtx_t *mutex);
 int mtx_trylock(mtx_t *mutex);
-int mtx_timedlock(mtx_t *mutex, const struct timespec *time_point);
 int mtx_unlock(mtx_t *mutex);
+#endif
+
+// extension: spin_count attempts of mtx_trylock (pausing exponentially longer up to backoff_max CPU relax hints)
+// before blocking in mtx_lock/mtx_timedlock; spin_count 0 disables spinning
+int mtx_set_spin(mtx_t *mutex, unsigned int spin_count, unsigned int backoff_max);
+
+// extension: name to identify the mutex by in profiling statistics; the string is not copied
+void mtx_set_name(mtx_t *mutex, const char *name);
 
 int thrd_create(thrd_t *thr, thrd_start_t func, void *arg);
+int thrd_create_ex(thrd_t *thr, thrd_start_t func, void *arg, const thrd_attr_t *attr);
 int thrd_sleep(const struct timespec *duration, struct timespec *remaining);
 int thrd_join(thrd_t thr, int *res);
+int thrd_detach(thrd_t thr);
+_Noreturn void thrd_exit(int res);
+thrd_t thrd_current();
+int thrd_equal(thrd_t lhs, thrd_t rhs);
+#ifndef THREADS_COMPAT_USE_INLINE
 void thrd_yield();
+#endif
 
 int cnd_init(cnd_t *cond);
 void cnd_destroy(cnd_t *cond);
 int cnd_wait(cnd_t *cond, mtx_t *mutex);
+#ifndef THREADS_COMPAT_USE_INLINE
+int cnd_signal(cnd_t *cond);
 int cnd_broadcast(cnd_t *cond);
+#endif
 int cnd_timedwait(cnd_t *cond, mtx_t *mutex, const struct timespec *time_point);
 
+// extension: like cnd_timedwait but time_point is based on CLOCK_MONOTONIC (as returned by clock_gettime) instead of
+// TIME_UTC; like TIME_UTC time points it is converted once to the internal clock, which on macOS does not advance while
+// the system is asleep
+int cnd_timedwait_monotonic(cnd_t *cond, mtx_t *mutex, const struct timespec *time_point);
+
+// extension: blocks while *address equals expected until woken by addr_wake/addr_wake_all on the same address;
+// may return spuriously, so callers need to check again what they are waiting for
+int addr_wait(atomic_uint *address, unsigned int expected);
+int addr_timedwait(atomic_uint *address, unsigned int expected, const struct timespec *time_point);
+int addr_wake(atomic_uint *address);
+int addr_wake_all(atomic_uint *address);
+
+int tss_create(tss_t *key, tss_dtor_t dtor);
+void tss_delete(tss_t key);
+int tss_set(tss_t key, void *val);
+
+static inline void* tss_get(tss_t key) {
+    threads_compat_tss_block_t *block = threads_compat_tss_block;
+    if (!block || block->slots[key.index].generation != key.generation) {
+        return NULL;
+    }
+
+    return block->slots[key.index].value;
+}
+
+void threads_compat_call_once_slow(once_flag *flag, void (*func)(void));
+
+static inline void call_once(once_flag *flag, void (*func)(void)) {
+    // fast path once initialized: a single acquire load, see threads_compat_call_once_slow for everything else
+    if (atomic_load_explicit(&flag->state, memory_order_acquire) == THREADS_COMPAT_ONCE_DONE) {
+        return;
+    }
+
+    threads_compat_call_once_slow(flag, func);
+}
+
+// extension: errors are queued to a lock-free ring buffer unless another handler is set (NULL restores the default);
+// handlers may be called concurrently by any thread while holding locks, so they should not block
+void threads_compat_set_error_handler(threads_compat_error_handler_t handler);
+size_t threads_compat_fetch_errors(threads_compat_error_t *errors, size_t max_errors);
+unsigned long threads_compat_dropped_errors();
+void threads_compat_print_error(const threads_compat_error_t *error);
+void threads_compat_report_error(const char *site, int err);
+
+// extension: mutex profiling, see THREADS_COMPAT_MTX_PROFILING; without it the registry is always empty
+// callbacks are invoked with the registry locked, so they must not initialize or destroy any mutex
+void threads_compat_mtx_stats_foreach(threads_compat_mtx_stats_callback_t callback, void *context);
+void threads_compat_mtx_stats_dump(FILE *out);
+void threads_compat_mtx_stats_reset();
+
+// extension: tracing, see THREADS_COMPAT_TRACING; events are only buffered if signposts are not used instead
+// export writes all buffered events as Chrome trace JSON and returns how many were written, reset must not be called
+// concurrently to any traced call
+size_t threads_compat_trace_export(FILE *out);
+void threads_compat_trace_reset();
+unsigned long threads_compat_trace_dropped();
+
+// internal: shared with the extension modules (threads_macos_compat_*.c)
+// deadlines are based on the internal monotonic clock (mach_absolute_time on macOS, CLOCK_MONOTONIC elsewhere) and
+// only obtained by threads_compat_monotonic_deadline; conditions waited on until a deadline must be initialized by
+// threads_compat_init_monotonic_cond; the deadline conversion and address waits return thrd_* codes, condition waits
+// and initialization return error numbers as returned by pthreads
+int threads_compat_monotonic_deadline(const struct timespec *time_point, struct timespec *deadline);
+int threads_compat_init_monotonic_cond(pthread_cond_t *cond);
+int threads_compat_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline);
+int threads_compat_addr_wait_until(atomic_uint *address, unsigned int expected, const struct timespec *deadline);
+
+// pauses the CPU for a moment while spinning
+static inline void threads_compat_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause" ::: "memory");
+#elif defined(__aarch64__)
+    // yield is effectively a no-op on Apple Silicon, isb actually delays the core for a short moment
+    __asm__ __volatile__("isb" ::: "memory");
+#elif defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+// out-of-line parts of the inline fast paths, always provided by threads_macos_compat.c
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADS_COMPAT_COLD __attribute__((cold, noinline))
+#else
+#define THREADS_COMPAT_COLD
+#endif
+
+int threads_compat_mtx_lock_slow(mtx_t *mutex);
+int threads_compat_mtx_trylock_slow(mtx_t *mutex);
+int threads_compat_mtx_unlock_slow(mtx_t *mutex);
+int threads_compat_cnd_wake_slow(cnd_t *cond, int all);
+THREADS_COMPAT_COLD int threads_compat_inline_error(const char *site, int err);
+
+#ifdef THREADS_COMPAT_USE_INLINE
+// extension: with THREADS_MACOS_COMPAT_INLINE defined, plain and recursive mutexes without spinning as well as
+// signalling without waiters only call pthreads (or os_unfair_lock); everything else takes the out-of-line path
+// with THREADS_COMPAT_ADDR_WAIT, plain mutexes are locked and unlocked by a single atomic operation if uncontended
+
+#ifdef THREADS_COMPAT_ADDR_WAIT
+static inline int mtx_lock(mtx_t *mutex) {
+    unsigned int expected = 0;
+    if (mutex->type == mtx_plain && atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1, memory_order_acquire, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    return threads_compat_mtx_lock_slow(mutex);
+}
+
+static inline int mtx_trylock(mtx_t *mutex) {
+    if (mutex->type != mtx_plain) {
+        return threads_compat_mtx_trylock_slow(mutex);
+    }
+
+    unsigned int expected = 0;
+    return atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1, memory_order_acquire, memory_order_relaxed) ? thrd_success : thrd_busy;
+}
+
+static inline int mtx_unlock(mtx_t *mutex) {
+    // anything but an uncontended lock (1) needs to wake a waiter or report an error; condition waiters handed off to
+    // the mutex always lock it as contended (2), so their unlocking takes the slow path and wakes the next one
+    unsigned int expected = 1;
+    if (mutex->type == mtx_plain && atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 0, memory_order_release, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    return threads_compat_mtx_unlock_slow(mutex);
+}
+#else
+static inline int mtx_lock(mtx_t *mutex) {
+    if (mutex->spin_count || (mutex->type & mtx_timed)) {
+        return threads_compat_mtx_lock_slow(mutex);
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if ((mutex->type & ~mtx_prio_inherit) == mtx_plain) {
+        os_unfair_lock_lock(&mutex->unfair);
+        return thrd_success;
+    }
+#endif
+
+    int err = pthread_mutex_lock(&mutex->mutex);
+    return err ? threads_compat_inline_error("pthread_mutex_lock", err) : thrd_success;
+}
+
+static inline int mtx_trylock(mtx_t *mutex) {
+    if (mutex->type & mtx_timed) {
+        return threads_compat_mtx_trylock_slow(mutex);
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if ((mutex->type & ~mtx_prio_inherit) == mtx_plain) {
+        return os_unfair_lock_trylock(&mutex->unfair) ? thrd_success : thrd_busy;
+    }
+#endif
+
+    int err = pthread_mutex_trylock(&mutex->mutex);
+    if (!err) {
+        return thrd_success;
+    }
+
+    return (err == EBUSY) ? thrd_busy : threads_compat_inline_error("pthread_mutex_trylock", err);
+}
+
+static inline int mtx_unlock(mtx_t *mutex) {
+    if (mutex->type & mtx_timed) {
+        return threads_compat_mtx_unlock_slow(mutex);
+    }
+
+#ifdef THREADS_COMPAT_USE_UNFAIR_LOCK
+    if ((mutex->type & ~mtx_prio_inherit) == mtx_plain) {
+        os_unfair_lock_unlock(&mutex->unfair);
+        return thrd_success;
+    }
+#endif
+
+    int err = pthread_mutex_unlock(&mutex->mutex);
+    return err ? threads_compat_inline_error("pthread_mutex_unlock", err) : thrd_success;
+}
+#endif
+
+static inline int cnd_signal(cnd_t *cond) {
+    if (!atomic_load_explicit(&cond->waiters, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    return threads_compat_cnd_wake_slow(cond, 0);
+}
+
+static inline int cnd_broadcast(cnd_t *cond) {
+    if (!atomic_load_explicit(&cond->waiters, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    return threads_compat_cnd_wake_slow(cond, 1);
+}
+
+static inline void thrd_yield() {
+    sched_yield();
+}
+#endif
+
 #endif
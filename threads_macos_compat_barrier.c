@@ -0,0 +1,195 @@
+/**
+ * Barriers and latches for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include <errno.h>
+
+#include "threads_macos_compat_barrier.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+// number of times a waiting thread checks for release before blocking
+#ifndef THREADS_COMPAT_BARRIER_SPIN_COUNT
+#define THREADS_COMPAT_BARRIER_SPIN_COUNT 1000
+#endif
+
+// Blocking threads register in sleepers, issue a fence and only then check the word once more. Releasing threads
+// issue a fence after changing the word and only wake if they see sleepers; either the sleeper sees the change or the
+// releasing thread sees the sleeper. Waiting on the word only blocks while it still has the value checked before.
+
+static int wait_for_change(atomic_uint *word, unsigned int value, atomic_uint *sleepers, const struct timespec *deadline) {
+    for (unsigned int i = 0; i < THREADS_COMPAT_BARRIER_SPIN_COUNT; i++) {
+        if (atomic_load_explicit(word, memory_order_acquire) != value) {
+            return thrd_success;
+        }
+
+        threads_compat_cpu_relax();
+    }
+
+    atomic_fetch_add_explicit(sleepers, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int res = thrd_success;
+    while (atomic_load_explicit(word, memory_order_acquire) == value) {
+        res = threads_compat_addr_wait_until(word, value, deadline);
+        if (res != thrd_success) {
+            break;
+        }
+    }
+
+    atomic_fetch_sub_explicit(sleepers, 1, memory_order_relaxed);
+
+    return res;
+}
+
+static int release(atomic_uint *word, atomic_uint *sleepers) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(sleepers, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    return addr_wake_all(word);
+}
+
+int barrier_init(barrier_t *barrier, unsigned int count) {
+    if (!count) {
+        report_error("barrier_init count", EINVAL);
+        return thrd_error;
+    }
+
+    barrier->count = count;
+    atomic_init(&barrier->arrived, 0);
+    atomic_init(&barrier->phase, 0);
+    atomic_init(&barrier->sleepers, 0);
+
+    return thrd_success;
+}
+
+void barrier_destroy(barrier_t *barrier) {
+    // nothing to release; waiting on an address does not hold any resources outside a wait
+    (void) barrier;
+}
+
+int barrier_wait(barrier_t *barrier) {
+    // the phase cannot advance before we arrive
+    unsigned int phase = atomic_load_explicit(&barrier->phase, memory_order_acquire);
+
+    if (atomic_fetch_add_explicit(&barrier->arrived, 1, memory_order_acq_rel) + 1 < barrier->count) {
+        return wait_for_change(&barrier->phase, phase, &barrier->sleepers, NULL);
+    }
+
+    // all others are waiting for the phase to change, so nobody can arrive for the next one before we advance it
+    atomic_store_explicit(&barrier->arrived, 0, memory_order_relaxed);
+    atomic_store_explicit(&barrier->phase, phase + 1, memory_order_release);
+
+    return release(&barrier->phase, &barrier->sleepers);
+}
+
+int latch_init(latch_t *latch, unsigned int count) {
+    atomic_init(&latch->count, count);
+    atomic_init(&latch->sleepers, 0);
+
+    return thrd_success;
+}
+
+void latch_destroy(latch_t *latch) {
+    (void) latch;
+}
+
+int latch_count_down(latch_t *latch, unsigned int n) {
+    unsigned int count = atomic_load_explicit(&latch->count, memory_order_relaxed);
+    do {
+        if (n > count) {
+            report_error("latch_count_down", EINVAL);
+            return thrd_error;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&latch->count, &count, count - n, memory_order_acq_rel, memory_order_relaxed));
+
+    if (!n || (count != n)) {
+        return thrd_success;
+    }
+
+    return release(&latch->count, &latch->sleepers);
+}
+
+static int latch_wait_until(latch_t *latch, const struct timespec *deadline) {
+    int res = thrd_success;
+
+    unsigned int count = atomic_load_explicit(&latch->count, memory_order_acquire);
+    while (count && (res == thrd_success)) {
+        res = wait_for_change(&latch->count, count, &latch->sleepers, deadline);
+        count = atomic_load_explicit(&latch->count, memory_order_acquire);
+    }
+
+    return count ? res : thrd_success;
+}
+
+int latch_wait(latch_t *latch) {
+    return latch_wait_until(latch, NULL);
+}
+
+int latch_trywait(latch_t *latch) {
+    return atomic_load_explicit(&latch->count, memory_order_acquire) ? thrd_busy : thrd_success;
+}
+
+int latch_timedwait(latch_t *latch, const struct timespec *time_point) {
+    if (!atomic_load_explicit(&latch->count, memory_order_acquire)) {
+        return thrd_success;
+    }
+
+    struct timespec deadline = {0};
+    if (threads_compat_monotonic_deadline(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    return latch_wait_until(latch, &deadline);
+}
@@ -0,0 +1,87 @@
+#ifndef THREADS_MACOS_COMPAT_BARRIER_H
+/**
+ * Barriers and latches for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#define THREADS_MACOS_COMPAT_BARRIER_H
+
+#include "threads_macos_compat.h"
+
+// extension: reusable barrier for a fixed number of threads; the phase is counted up by the last thread to arrive,
+// which releases all others at once (sense reversal without resetting a flag per thread)
+typedef struct {
+    unsigned int count;
+    atomic_uint arrived;
+    atomic_uint phase;
+
+    // threads blocked or about to block on phase, releasing only wakes if there are any
+    atomic_uint sleepers;
+} barrier_t;
+
+// extension: one-shot countdown, waiting threads are released once the count reaches zero
+typedef struct {
+    atomic_uint count;
+    atomic_uint sleepers;
+} latch_t;
+
+// count must not be zero
+int barrier_init(barrier_t *barrier, unsigned int count);
+void barrier_destroy(barrier_t *barrier);
+
+// waits until count threads have arrived, spinning briefly before blocking
+int barrier_wait(barrier_t *barrier);
+
+int latch_init(latch_t *latch, unsigned int count);
+void latch_destroy(latch_t *latch);
+
+// fails without changing the count if n exceeds it
+int latch_count_down(latch_t *latch, unsigned int n);
+
+// waits until the count has reached zero, spinning briefly before blocking; trywait returns thrd_busy instead
+int latch_wait(latch_t *latch);
+int latch_trywait(latch_t *latch);
+int latch_timedwait(latch_t *latch, const struct timespec *time_point);
+
+#endif
@@ -0,0 +1,311 @@
+/**
+ * Bounded multi-producer multi-consumer channels for the C11 threads
+ * compatibility wrapper for the macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <errno.h>
+
+#include "threads_macos_compat_chan.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+// Each cell carries a sequence number telling which position it is ready for: a cell at position p can be pushed to
+// when its sequence equals p and popped from when it equals p + 1. Threads claim a range of ready cells by a single
+// compare-and-swap on the position, fill or empty them and finally publish the sequence for the next round.
+//
+// Threads which have to wait register in the waiting counter of their direction, issue a fence and only then check
+// the channel again. The other side issues a fence after publishing cells and only counts up the event and wakes if
+// it sees waiters; either the waiter sees the cells or the waker sees the waiter. Waiting on the event address only
+// blocks while it still has the value read before checking the channel, so no wake up can be missed.
+
+int chan_init(chan_t *chan, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        if (size > (SIZE_MAX >> 1)) {
+            report_error("chan_init capacity", EINVAL);
+            return thrd_error;
+        }
+
+        size <<= 1;
+    }
+
+    chan->cells = calloc(size, sizeof(threads_compat_chan_cell_t));
+    if (!chan->cells) {
+        report_error("chan_init calloc", ENOMEM);
+        return thrd_nomem;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&chan->cells[i].sequence, i);
+    }
+
+    chan->mask = size - 1;
+    atomic_init(&chan->push_position, 0);
+    atomic_init(&chan->pop_position, 0);
+    atomic_init(&chan->pushers_waiting, 0);
+    atomic_init(&chan->poppers_waiting, 0);
+    atomic_init(&chan->not_full, 0);
+    atomic_init(&chan->not_empty, 0);
+
+    return thrd_success;
+}
+
+void chan_destroy(chan_t *chan) {
+    free(chan->cells);
+    chan->cells = NULL;
+}
+
+static size_t claim(chan_t *chan, atomic_size_t *position, size_t ready_offset, size_t max, size_t *first) {
+    // claims up to max consecutive cells which are ready for the position plus ready_offset, returns 0 if the very
+    // first cell is not ready (channel full or empty)
+    if (!max) {
+        return 0;
+    }
+
+    size_t pos = atomic_load_explicit(position, memory_order_relaxed);
+    while (true) {
+        size_t num_ready = 0;
+        intptr_t diff = 0;
+        while (num_ready < max) {
+            size_t sequence = atomic_load_explicit(&chan->cells[(pos + num_ready) & chan->mask].sequence, memory_order_acquire);
+            diff = (intptr_t) (sequence - (pos + num_ready + ready_offset));
+            if (diff) {
+                break;
+            }
+
+            num_ready++;
+        }
+
+        if (!num_ready) {
+            if (diff < 0) {
+                return 0;
+            }
+
+            // another thread claimed the position meanwhile
+            pos = atomic_load_explicit(position, memory_order_relaxed);
+            continue;
+        }
+
+        // cells can only change after the position has been claimed, so all of them are still ready on success
+        if (atomic_compare_exchange_weak_explicit(position, &pos, pos + num_ready, memory_order_relaxed, memory_order_relaxed)) {
+            *first = pos;
+            return num_ready;
+        }
+    }
+}
+
+static int notify(atomic_uint *waiting, atomic_uint *event, bool all) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(waiting, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    atomic_fetch_add(event, 1);
+
+    return all ? addr_wake_all(event) : addr_wake(event);
+}
+
+static size_t try_push(chan_t *chan, void *const *items, size_t count) {
+    size_t first = 0;
+    size_t num_claimed = claim(chan, &chan->push_position, 0, count, &first);
+
+    for (size_t i = 0; i < num_claimed; i++) {
+        threads_compat_chan_cell_t *cell = &chan->cells[(first + i) & chan->mask];
+        cell->item = items[i];
+        atomic_store_explicit(&cell->sequence, first + i + 1, memory_order_release);
+    }
+
+    if (num_claimed) {
+        notify(&chan->poppers_waiting, &chan->not_empty, num_claimed > 1);
+    }
+
+    return num_claimed;
+}
+
+static size_t try_pop(chan_t *chan, void **items, size_t max) {
+    size_t first = 0;
+    size_t num_claimed = claim(chan, &chan->pop_position, 1, max, &first);
+
+    for (size_t i = 0; i < num_claimed; i++) {
+        threads_compat_chan_cell_t *cell = &chan->cells[(first + i) & chan->mask];
+        items[i] = cell->item;
+        atomic_store_explicit(&cell->sequence, first + i + chan->mask + 1, memory_order_release);
+    }
+
+    if (num_claimed) {
+        notify(&chan->pushers_waiting, &chan->not_full, num_claimed > 1);
+    }
+
+    return num_claimed;
+}
+
+static int wait_push(chan_t *chan, void *const *items, size_t count) {
+    atomic_fetch_add_explicit(&chan->pushers_waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int res = thrd_success;
+    while (count) {
+        unsigned int event = atomic_load(&chan->not_full);
+        size_t num_pushed = try_push(chan, items, count);
+        items += num_pushed;
+        count -= num_pushed;
+
+        if (count && !num_pushed) {
+            res = threads_compat_addr_wait_until(&chan->not_full, event, NULL);
+            if (res != thrd_success) {
+                break;
+            }
+        }
+    }
+
+    atomic_fetch_sub_explicit(&chan->pushers_waiting, 1, memory_order_relaxed);
+
+    return res;
+}
+
+static int wait_pop(chan_t *chan, void **items, size_t max, size_t *popped, const struct timespec *deadline) {
+    atomic_fetch_add_explicit(&chan->poppers_waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int res = thrd_success;
+    size_t num_popped = 0;
+    while (true) {
+        unsigned int event = atomic_load(&chan->not_empty);
+        num_popped = try_pop(chan, items, max);
+        if (num_popped || (res != thrd_success)) {
+            // also checked once more after timing out as items may have been pushed meanwhile
+            break;
+        }
+
+        res = threads_compat_addr_wait_until(&chan->not_empty, event, deadline);
+        if ((res != thrd_success) && (res != thrd_timedout)) {
+            break;
+        }
+    }
+
+    atomic_fetch_sub_explicit(&chan->poppers_waiting, 1, memory_order_relaxed);
+
+    if (popped) {
+        *popped = num_popped;
+    }
+
+    return num_popped ? thrd_success : res;
+}
+
+int chan_push(chan_t *chan, void *item) {
+    if (try_push(chan, &item, 1)) {
+        return thrd_success;
+    }
+
+    return wait_push(chan, &item, 1);
+}
+
+int chan_trypush(chan_t *chan, void *item) {
+    return try_push(chan, &item, 1) ? thrd_success : thrd_busy;
+}
+
+int chan_push_batch(chan_t *chan, void *const *items, size_t count) {
+    size_t num_pushed = try_push(chan, items, count);
+    if (num_pushed == count) {
+        return thrd_success;
+    }
+
+    return wait_push(chan, items + num_pushed, count - num_pushed);
+}
+
+int chan_pop(chan_t *chan, void **item) {
+    if (try_pop(chan, item, 1)) {
+        return thrd_success;
+    }
+
+    return wait_pop(chan, item, 1, NULL, NULL);
+}
+
+int chan_trypop(chan_t *chan, void **item) {
+    return try_pop(chan, item, 1) ? thrd_success : thrd_busy;
+}
+
+int chan_timedpop(chan_t *chan, void **item, const struct timespec *time_point) {
+    return chan_timedpop_batch(chan, item, 1, NULL, time_point);
+}
+
+int chan_pop_batch(chan_t *chan, void **items, size_t max, size_t *popped) {
+    size_t num_popped = try_pop(chan, items, max);
+    if (num_popped || !max) {
+        if (popped) {
+            *popped = num_popped;
+        }
+
+        return thrd_success;
+    }
+
+    return wait_pop(chan, items, max, popped, NULL);
+}
+
+int chan_timedpop_batch(chan_t *chan, void **items, size_t max, size_t *popped, const struct timespec *time_point) {
+    size_t num_popped = try_pop(chan, items, max);
+    if (num_popped || !max) {
+        if (popped) {
+            *popped = num_popped;
+        }
+
+        return thrd_success;
+    }
+
+    struct timespec deadline = {0};
+    if (threads_compat_monotonic_deadline(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    return wait_pop(chan, items, max, popped, &deadline);
+}
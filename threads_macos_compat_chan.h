@@ -0,0 +1,94 @@
+#ifndef THREADS_MACOS_COMPAT_CHAN_H
+/**
+ * Bounded multi-producer multi-consumer channels for the C11 threads
+ * compatibility wrapper for the macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#define THREADS_MACOS_COMPAT_CHAN_H
+
+#include "threads_macos_compat.h"
+
+typedef struct {
+    atomic_size_t sequence;
+    void *item;
+} threads_compat_chan_cell_t;
+
+// extension: bounded multi-producer multi-consumer queue of pointers; pushing and popping claim cells of a ring by a
+// single atomic operation per call (also for batches), threads only block (see addr_wait) while the channel is full
+// or empty
+typedef struct {
+    // advanced by producers and consumers independently, kept on separate cache lines
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) atomic_size_t push_position;
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) atomic_size_t pop_position;
+
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) threads_compat_chan_cell_t *cells;
+    size_t mask;
+
+    // threads waiting or about to wait for the events, which are only counted up while there are any
+    atomic_uint pushers_waiting;
+    atomic_uint poppers_waiting;
+    atomic_uint not_full;
+    atomic_uint not_empty;
+} chan_t;
+
+// capacity is rounded up to a power of two, at least 2
+int chan_init(chan_t *chan, size_t capacity);
+
+// items still queued are not released
+void chan_destroy(chan_t *chan);
+
+// push waits while the channel is full, trypush returns thrd_busy instead; batches wait until all items are queued
+int chan_push(chan_t *chan, void *item);
+int chan_trypush(chan_t *chan, void *item);
+int chan_push_batch(chan_t *chan, void *const *items, size_t count);
+
+// pop waits while the channel is empty, trypop returns thrd_busy instead; batches only wait for the first item and
+// then take up to max items which are immediately available, the number of items taken is stored to popped
+int chan_pop(chan_t *chan, void **item);
+int chan_trypop(chan_t *chan, void **item);
+int chan_timedpop(chan_t *chan, void **item, const struct timespec *time_point);
+int chan_pop_batch(chan_t *chan, void **items, size_t max, size_t *popped);
+int chan_timedpop_batch(chan_t *chan, void **items, size_t max, size_t *popped, const struct timespec *time_point);
+
+#endif
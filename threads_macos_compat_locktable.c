@@ -0,0 +1,217 @@
+/**
+ * Striped lock tables for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <errno.h>
+
+#include "threads_macos_compat_locktable.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+// stripe indices of up to this many keys are sorted on the stack without allocating
+#define MANY_KEYS_ON_STACK 16
+
+int lock_table_init(lock_table_t *table, size_t num_stripes, int type) {
+    size_t size = 1;
+    unsigned int bits = 0;
+    while (size < num_stripes) {
+        if (size > (SIZE_MAX >> 1)) {
+            report_error("lock_table_init num_stripes", EINVAL);
+            return thrd_error;
+        }
+
+        size <<= 1;
+        bits++;
+    }
+
+    void *stripes = NULL;
+    int err = posix_memalign(&stripes, THREADS_COMPAT_CACHE_LINE_SIZE, sizeof(mtx_padded_t) * size);
+    if (err) {
+        report_error("lock_table_init posix_memalign", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+
+    table->stripes = stripes;
+    table->num_stripes = size;
+
+    // Fibonacci hashing takes the upper bits of the product, shifting by 64 would be undefined for a single stripe
+    table->shift = bits ? (64 - bits) : 63;
+
+    for (size_t i = 0; i < size; i++) {
+        int res = mtx_init(&table->stripes[i].mutex, type);
+        if (res != thrd_success) {
+            while (i--) {
+                mtx_destroy(&table->stripes[i].mutex);
+            }
+
+            free(table->stripes);
+            table->stripes = NULL;
+            return res;
+        }
+    }
+
+    return thrd_success;
+}
+
+void lock_table_destroy(lock_table_t *table) {
+    for (size_t i = 0; i < table->num_stripes; i++) {
+        mtx_destroy(&table->stripes[i].mutex);
+    }
+
+    free(table->stripes);
+    table->stripes = NULL;
+}
+
+static inline size_t stripe_index(lock_table_t *table, uintptr_t key) {
+    // keys are often aligned addresses or sequential, multiplying spreads all bits into the upper ones
+    return (size_t) (((uint64_t) key * UINT64_C(0x9E3779B97F4A7C15)) >> table->shift) & (table->num_stripes - 1);
+}
+
+mtx_t* lock_table_get(lock_table_t *table, uintptr_t key) {
+    return &table->stripes[stripe_index(table, key)].mutex;
+}
+
+int lock_table_lock(lock_table_t *table, uintptr_t key) {
+    return mtx_lock(lock_table_get(table, key));
+}
+
+int lock_table_trylock(lock_table_t *table, uintptr_t key) {
+    return mtx_trylock(lock_table_get(table, key));
+}
+
+int lock_table_unlock(lock_table_t *table, uintptr_t key) {
+    return mtx_unlock(lock_table_get(table, key));
+}
+
+static int compare_indices(const void *a, const void *b) {
+    size_t index_a = *((const size_t*) a);
+    size_t index_b = *((const size_t*) b);
+
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+static size_t sorted_stripes(lock_table_t *table, const uintptr_t *keys, size_t num_keys, size_t *indices) {
+    // fills indices with the distinct stripes of all keys in ascending order, returns how many there are
+    for (size_t i = 0; i < num_keys; i++) {
+        indices[i] = stripe_index(table, keys[i]);
+    }
+
+    if (num_keys <= MANY_KEYS_ON_STACK) {
+        for (size_t i = 1; i < num_keys; i++) {
+            size_t index = indices[i];
+            size_t j = i;
+            while (j && (indices[j - 1] > index)) {
+                indices[j] = indices[j - 1];
+                j--;
+            }
+            indices[j] = index;
+        }
+    } else {
+        qsort(indices, num_keys, sizeof(size_t), compare_indices);
+    }
+
+    size_t num_distinct = 0;
+    for (size_t i = 0; i < num_keys; i++) {
+        if (!num_distinct || (indices[num_distinct - 1] != indices[i])) {
+            indices[num_distinct++] = indices[i];
+        }
+    }
+
+    return num_distinct;
+}
+
+static int lock_many(lock_table_t *table, const uintptr_t *keys, size_t num_keys, bool lock) {
+    size_t indices_on_stack[MANY_KEYS_ON_STACK];
+    size_t *indices = indices_on_stack;
+    if (num_keys > MANY_KEYS_ON_STACK) {
+        indices = malloc(sizeof(size_t) * num_keys);
+        if (!indices) {
+            report_error("lock_table_lock_many malloc", ENOMEM);
+            return thrd_nomem;
+        }
+    }
+
+    int res = thrd_success;
+    size_t num_stripes = sorted_stripes(table, keys, num_keys, indices);
+    if (lock) {
+        for (size_t i = 0; i < num_stripes; i++) {
+            res = mtx_lock(&table->stripes[indices[i]].mutex);
+            if (res != thrd_success) {
+                while (i--) {
+                    mtx_unlock(&table->stripes[indices[i]].mutex);
+                }
+                break;
+            }
+        }
+    } else {
+        for (size_t i = num_stripes; i--;) {
+            if (mtx_unlock(&table->stripes[indices[i]].mutex) != thrd_success) {
+                res = thrd_error;
+            }
+        }
+    }
+
+    if (indices != indices_on_stack) {
+        free(indices);
+    }
+
+    return res;
+}
+
+int lock_table_lock_many(lock_table_t *table, const uintptr_t *keys, size_t num_keys) {
+    return lock_many(table, keys, num_keys, true);
+}
+
+int lock_table_unlock_many(lock_table_t *table, const uintptr_t *keys, size_t num_keys) {
+    return lock_many(table, keys, num_keys, false);
+}
@@ -0,0 +1,76 @@
+#ifndef THREADS_MACOS_COMPAT_LOCKTABLE_H
+/**
+ * Striped lock tables for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#define THREADS_MACOS_COMPAT_LOCKTABLE_H
+
+#include "threads_macos_compat.h"
+
+// extension: fixed number of padded mutexes to lock keys (or addresses cast to uintptr_t) by; keys are hashed to a
+// stripe, so different keys may share a mutex
+typedef struct {
+    mtx_padded_t *stripes;
+    size_t num_stripes;
+    unsigned int shift;
+} lock_table_t;
+
+// num_stripes is rounded up to a power of two, type is passed to mtx_init
+int lock_table_init(lock_table_t *table, size_t num_stripes, int type);
+void lock_table_destroy(lock_table_t *table);
+
+// mutex a key is guarded by
+mtx_t* lock_table_get(lock_table_t *table, uintptr_t key);
+
+int lock_table_lock(lock_table_t *table, uintptr_t key);
+int lock_table_trylock(lock_table_t *table, uintptr_t key);
+int lock_table_unlock(lock_table_t *table, uintptr_t key);
+
+// locks the stripes of all keys in ascending order, each stripe once even if shared by keys; all or no stripes are
+// locked on return, so concurrent callers cannot deadlock on overlapping sets of keys
+int lock_table_lock_many(lock_table_t *table, const uintptr_t *keys, size_t num_keys);
+int lock_table_unlock_many(lock_table_t *table, const uintptr_t *keys, size_t num_keys);
+
+#endif
@@ -0,0 +1,282 @@
+/**
+ * Completion notifications for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <errno.h>
+
+#include "threads_macos_compat_notify.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+// states of completed
+#define NOTIFY_PENDING (0)
+#define NOTIFY_CLAIMED (1)
+#define NOTIFY_COMPLETED (2)
+
+// The notifying thread copies the target before publishing the completion: as soon as notify_tryget can see the
+// result the owner is free to destroy the notification, so it must not be accessed anymore afterwards. A dispatch
+// source is retained for that time and kevents which have already been deleted fail with ENOENT, which is ignored.
+// Completing is claimed first, so racing calls of notify_complete fail without touching the result.
+
+static void init_common(notify_t *notify) {
+    atomic_init(&notify->completed, NOTIFY_PENDING);
+    notify->res = 0;
+    notify->kqueue = -1;
+    notify->ident = 0;
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    notify->source = NULL;
+#endif
+    notify->callback = NULL;
+    notify->context = NULL;
+    notify->func = NULL;
+    notify->arg = NULL;
+}
+
+#ifdef THREADS_COMPAT_USE_KQUEUE
+int notify_init_kevent(notify_t *notify, int kqueue, uintptr_t ident) {
+    init_common(notify);
+
+    struct kevent change;
+    EV_SET(&change, ident, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, notify);
+    if (kevent(kqueue, &change, 1, NULL, 0, NULL) < 0) {
+        int err = errno;
+        report_error("notify_init_kevent kevent", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+
+    notify->kqueue = kqueue;
+    notify->ident = ident;
+
+    return thrd_success;
+}
+#endif
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+int notify_init_dispatch(notify_t *notify, dispatch_source_t source) {
+    init_common(notify);
+
+    if (!source) {
+        report_error("notify_init_dispatch source", EINVAL);
+        return thrd_error;
+    }
+
+    dispatch_retain(source);
+    notify->source = source;
+
+    return thrd_success;
+}
+#endif
+
+int notify_init_callback(notify_t *notify, notify_callback_t callback, void *context) {
+    init_common(notify);
+
+    if (!callback) {
+        report_error("notify_init_callback callback", EINVAL);
+        return thrd_error;
+    }
+
+    notify->callback = callback;
+    notify->context = context;
+
+    return thrd_success;
+}
+
+void notify_destroy(notify_t *notify) {
+#ifdef THREADS_COMPAT_USE_KQUEUE
+    if (notify->kqueue >= 0) {
+        struct kevent change;
+        EV_SET(&change, notify->ident, EVFILT_USER, EV_DELETE, 0, 0, NULL);
+        if ((kevent(notify->kqueue, &change, 1, NULL, 0, NULL) < 0) && (errno != ENOENT)) {
+            report_error("notify_destroy kevent", errno);
+        }
+
+        notify->kqueue = -1;
+    }
+#endif
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    if (notify->source) {
+        dispatch_release(notify->source);
+        notify->source = NULL;
+    }
+#endif
+
+    notify->callback = NULL;
+}
+
+static int trigger(notify_t *notify, int kqueue, uintptr_t ident, const void *source, notify_callback_t callback,
+                   void *context) {
+    // notify is only passed on as udata of the kevent, it is not accessed as it may already have been destroyed
+#ifdef THREADS_COMPAT_USE_KQUEUE
+    if (kqueue >= 0) {
+        struct kevent change;
+        EV_SET(&change, ident, EVFILT_USER, 0, NOTE_TRIGGER, 0, notify);
+        if ((kevent(kqueue, &change, 1, NULL, 0, NULL) < 0) && (errno != ENOENT)) {
+            report_error("notify trigger kevent", errno);
+            return thrd_error;
+        }
+
+        return thrd_success;
+    }
+#else
+    (void) notify;
+    (void) kqueue;
+    (void) ident;
+#endif
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    if (source) {
+        dispatch_source_merge_data((dispatch_source_t) source, 1);
+        return thrd_success;
+    }
+#else
+    (void) source;
+#endif
+
+    if (callback) {
+        callback(context);
+        return thrd_success;
+    }
+
+    report_error("notify trigger target", EINVAL);
+    return thrd_error;
+}
+
+int notify_signal(notify_t *notify) {
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    const void *source = notify->source;
+#else
+    const void *source = NULL;
+#endif
+
+    return trigger(notify, notify->kqueue, notify->ident, source, notify->callback, notify->context);
+}
+
+int notify_complete(notify_t *notify, int res) {
+    // only the call which claims the notification may write the result; losing calls must not touch it anymore
+    unsigned int expected = NOTIFY_PENDING;
+    if (!atomic_compare_exchange_strong_explicit(&notify->completed, &expected, NOTIFY_CLAIMED, memory_order_relaxed,
+                                                 memory_order_relaxed)) {
+        report_error("notify_complete completed", EINVAL);
+        return thrd_error;
+    }
+
+    int kqueue = notify->kqueue;
+    uintptr_t ident = notify->ident;
+    notify_callback_t callback = notify->callback;
+    void *context = notify->context;
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    dispatch_source_t source = notify->source;
+    if (source) {
+        dispatch_retain(source);
+    }
+#else
+    const void *source = NULL;
+#endif
+
+    notify->res = res;
+    atomic_store_explicit(&notify->completed, NOTIFY_COMPLETED, memory_order_release);
+
+    int result = trigger(notify, kqueue, ident, source, callback, context);
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    if (source) {
+        dispatch_release(source);
+    }
+#endif
+
+    return result;
+}
+
+int notify_tryget(notify_t *notify, int *res) {
+    if (atomic_load_explicit(&notify->completed, memory_order_acquire) != NOTIFY_COMPLETED) {
+        return thrd_busy;
+    }
+
+    if (res) {
+        *res = notify->res;
+    }
+
+    return thrd_success;
+}
+
+static int notify_thread_start(void *arg) {
+    notify_t *notify = arg;
+
+    int res = notify->func(notify->arg);
+    notify_complete(notify, res);
+
+    return res;
+}
+
+int thrd_create_notify(thrd_t *thr, thrd_start_t func, void *arg, notify_t *notify) {
+    if (!func || (atomic_load_explicit(&notify->completed, memory_order_relaxed) != NOTIFY_PENDING)) {
+        report_error("thrd_create_notify", EINVAL);
+        return thrd_error;
+    }
+
+    notify->func = func;
+    notify->arg = arg;
+
+    int res = thrd_create(thr, notify_thread_start, notify);
+    if (res != thrd_success) {
+        return res;
+    }
+
+    // the thread is already running, so it will complete the notification no matter if it could be detached
+    if (thrd_detach(*thr) != thrd_success) {
+        report_error("thrd_create_notify thrd_detach", EINVAL);
+    }
+
+    return thrd_success;
+}
@@ -0,0 +1,132 @@
+#ifndef THREADS_MACOS_COMPAT_NOTIFY_H
+/**
+ * Completion notifications for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#define THREADS_MACOS_COMPAT_NOTIFY_H
+
+#include "threads_macos_compat.h"
+
+// event loops based on kqueue (EVFILT_USER) are supported on macOS and FreeBSD, dispatch sources wherever libdispatch
+// is available (always on macOS)
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#define THREADS_COMPAT_USE_KQUEUE
+#endif
+
+#if defined(__APPLE__)
+#define THREADS_COMPAT_USE_DISPATCH
+#elif defined(__has_include)
+#if __has_include(<dispatch/dispatch.h>)
+#define THREADS_COMPAT_USE_DISPATCH
+#endif
+#endif
+
+#ifdef THREADS_COMPAT_USE_KQUEUE
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+#include <dispatch/dispatch.h>
+#endif
+
+typedef void (*notify_callback_t)(void *context);
+
+// extension: notifies an event loop instead of requiring a blocked thread to wait for thrd_join or cnd_wait; a
+// notification can carry a result which is then collected without blocking (see notify_tryget)
+typedef struct {
+    // 0 while pending, 1 while notify_complete writes the result, 2 once completed and res is valid
+    atomic_uint completed;
+    int res;
+
+    // only one target is set, depending on how the notification has been initialized
+    int kqueue;
+    uintptr_t ident;
+#ifdef THREADS_COMPAT_USE_DISPATCH
+    dispatch_source_t source;
+#endif
+    notify_callback_t callback;
+    void *context;
+
+    // function run by thrd_create_notify, only read by the new thread when it starts
+    thrd_start_t func;
+    void *arg;
+} notify_t;
+
+#ifdef THREADS_COMPAT_USE_KQUEUE
+// triggers an EVFILT_USER event of the given ident on kqueue which is added (EV_CLEAR, udata points to notify) by
+// init and deleted by destroy; the kqueue needs to remain open until then
+int notify_init_kevent(notify_t *notify, int kqueue, uintptr_t ident);
+#endif
+
+#ifdef THREADS_COMPAT_USE_DISPATCH
+// merges 1 into a DISPATCH_SOURCE_TYPE_DATA_ADD or DISPATCH_SOURCE_TYPE_DATA_OR source, which is retained until destroy
+int notify_init_dispatch(notify_t *notify, dispatch_source_t source);
+#endif
+
+// calls callback(context) on the notifying thread, e.g. to write to an eventfd or pipe of other event loops; context
+// needs to remain valid until the callback has been received, not only until notify_tryget succeeds
+int notify_init_callback(notify_t *notify, notify_callback_t callback, void *context);
+
+void notify_destroy(notify_t *notify);
+
+// notifies the target without completing, e.g. after changing the state other threads would wait for by cnd_wait;
+// multiple notifications before the event loop picks them up may be coalesced
+int notify_signal(notify_t *notify);
+
+// stores res to be collected by notify_tryget and notifies the target; only the first call succeeds, further calls
+// fail with thrd_error and leave the result unchanged
+int notify_complete(notify_t *notify, int res);
+
+// collects the result of notify_complete, thrd_busy if not completed yet; never blocks
+int notify_tryget(notify_t *notify, int *res);
+
+// starts a detached thread running func(arg) which completes notify with the result once func has returned (threads
+// must not call thrd_exit); notify must be initialized and must not be completed yet. Other than by thrd_current and
+// thrd_equal, thr must not be used as the thread is detached.
+int thrd_create_notify(thrd_t *thr, thrd_start_t func, void *arg, notify_t *notify);
+
+#endif
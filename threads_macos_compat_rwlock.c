@@ -0,0 +1,359 @@
+/**
+ * Reader-writer locks for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include <errno.h>
+
+#include "threads_macos_compat_rwlock.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+#define WRITER THREADS_COMPAT_RWL_WRITER
+#define WRITERS_WAITING THREADS_COMPAT_RWL_WRITERS_WAITING
+#define READERS_WAITING THREADS_COMPAT_RWL_READERS_WAITING
+#define READERS_MASK THREADS_COMPAT_RWL_READERS_MASK
+
+// Waiting threads announce themselves by a flag in state while holding guard and only wait after checking state
+// again, also while holding guard. Any thread releasing the lock does so by a single atomic operation on state which
+// also tells it if there are waiters to wake up; waking up also needs guard, so no waiter can be missed.
+
+int rwl_init(rwl_t *lock) {
+    atomic_init(&lock->state, 0);
+    lock->writers_waiting = 0;
+
+    int err = pthread_mutex_init(&lock->guard, NULL);
+    if (err) {
+        report_error("rwl_init pthread_mutex_init", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+
+    err = threads_compat_init_monotonic_cond(&lock->readers);
+    if (err) {
+        report_error("rwl_init pthread_cond_init", err);
+        goto fail_guard;
+    }
+
+    err = threads_compat_init_monotonic_cond(&lock->writers);
+    if (err) {
+        report_error("rwl_init pthread_cond_init", err);
+        goto fail_readers;
+    }
+
+    return thrd_success;
+
+fail_readers:
+    pthread_cond_destroy(&lock->readers);
+
+fail_guard:
+    pthread_mutex_destroy(&lock->guard);
+
+    return (err == ENOMEM) ? thrd_nomem : thrd_error;
+}
+
+void rwl_destroy(rwl_t *lock) {
+    int err = pthread_cond_destroy(&lock->writers);
+    if (err) {
+        report_error("rwl_destroy pthread_cond_destroy", err);
+    }
+
+    err = pthread_cond_destroy(&lock->readers);
+    if (err) {
+        report_error("rwl_destroy pthread_cond_destroy", err);
+    }
+
+    err = pthread_mutex_destroy(&lock->guard);
+    if (err) {
+        report_error("rwl_destroy pthread_mutex_destroy", err);
+    }
+}
+
+static inline bool try_shared(rwl_t *lock, unsigned int *state) {
+    // state is the expected value and gets updated on failure
+    while (!(*state & (WRITER | WRITERS_WAITING)) && ((*state & READERS_MASK) < READERS_MASK)) {
+        if (atomic_compare_exchange_weak_explicit(&lock->state, state, *state + 1, memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static inline bool try_exclusive(rwl_t *lock, unsigned int *state) {
+    // waiting flags are kept as they are
+    while (!(*state & (WRITER | READERS_MASK))) {
+        if (atomic_compare_exchange_weak_explicit(&lock->state, state, *state | WRITER, memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int wake(rwl_t *lock, bool writers, bool readers) {
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&lock->guard);
+    if (err) {
+        report_error("rwl guard pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    // all writers have to be woken up, signalling just one could get lost on a writer timing out at the same time
+    if (writers) {
+        err = pthread_cond_broadcast(&lock->writers);
+        if (err) {
+            report_error("rwl writers pthread_cond_broadcast", err);
+            res = thrd_error;
+        }
+    }
+
+    if (readers) {
+        err = pthread_cond_broadcast(&lock->readers);
+        if (err) {
+            report_error("rwl readers pthread_cond_broadcast", err);
+            res = thrd_error;
+        }
+    }
+
+    err = pthread_mutex_unlock(&lock->guard);
+    if (err) {
+        report_error("rwl guard pthread_mutex_unlock", err);
+        res = thrd_error;
+    }
+
+    return res;
+}
+
+static int wait_shared(rwl_t *lock, const struct timespec *deadline) {
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&lock->guard);
+    if (err) {
+        report_error("rwl guard pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    while (!try_shared(lock, &state)) {
+        if (!(state & (WRITER | WRITERS_WAITING))) {
+            // only possible if the reader count is exhausted
+            report_error("rwl_lock_shared too many readers", EAGAIN);
+            res = thrd_error;
+            break;
+        }
+
+        // the flag has to be set on exactly the state we checked, otherwise the lock may just have been released
+        if (!(state & READERS_WAITING) && !atomic_compare_exchange_weak_explicit(&lock->state, &state, state | READERS_WAITING, memory_order_relaxed, memory_order_relaxed)) {
+            continue;
+        }
+
+        err = threads_compat_cond_wait_until(&lock->readers, &lock->guard, deadline);
+        if (err == ETIMEDOUT) {
+            res = thrd_timedout;
+            break;
+        } else if (err) {
+            report_error("rwl readers pthread_cond_(timed)wait", err);
+            res = thrd_error;
+            break;
+        }
+
+        state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    }
+
+    err = pthread_mutex_unlock(&lock->guard);
+    if (err) {
+        report_error("rwl guard pthread_mutex_unlock", err);
+        if (res == thrd_success) {
+            // we still hold a shared lock, so the result must remain thrd_success
+            return thrd_success;
+        }
+        return thrd_error;
+    }
+
+    return res;
+}
+
+static int wait_exclusive(rwl_t *lock, const struct timespec *deadline) {
+    int res = thrd_success;
+
+    int err = pthread_mutex_lock(&lock->guard);
+    if (err) {
+        report_error("rwl guard pthread_mutex_lock", err);
+        return thrd_error;
+    }
+
+    // the flag stays set until the last waiting writer leaves, which also keeps new readers out
+    if (!lock->writers_waiting++) {
+        atomic_fetch_or_explicit(&lock->state, WRITERS_WAITING, memory_order_relaxed);
+    }
+
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    while (!try_exclusive(lock, &state)) {
+        err = threads_compat_cond_wait_until(&lock->writers, &lock->guard, deadline);
+        if (err == ETIMEDOUT) {
+            res = thrd_timedout;
+            break;
+        } else if (err) {
+            report_error("rwl writers pthread_cond_(timed)wait", err);
+            res = thrd_error;
+            break;
+        }
+
+        state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    }
+
+    if (!--lock->writers_waiting) {
+        unsigned int previous = atomic_fetch_and_explicit(&lock->state, ~WRITERS_WAITING, memory_order_relaxed);
+
+        // readers may have been waiting only because of us; the flag is kept in case they still need to wait
+        if (res != thrd_success && (previous & READERS_WAITING)) {
+            err = pthread_cond_broadcast(&lock->readers);
+            if (err) {
+                report_error("rwl readers pthread_cond_broadcast", err);
+            }
+        }
+    }
+
+    err = pthread_mutex_unlock(&lock->guard);
+    if (err) {
+        report_error("rwl guard pthread_mutex_unlock", err);
+        if (res == thrd_success) {
+            // we still hold the lock, so the result must remain thrd_success
+            return thrd_success;
+        }
+        return thrd_error;
+    }
+
+    return res;
+}
+
+int rwl_lock_shared(rwl_t *lock) {
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    if (try_shared(lock, &state)) {
+        return thrd_success;
+    }
+
+    return wait_shared(lock, NULL);
+}
+
+int rwl_trylock_shared(rwl_t *lock) {
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    return try_shared(lock, &state) ? thrd_success : thrd_busy;
+}
+
+int rwl_timedlock_shared(rwl_t *lock, const struct timespec *time_point) {
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    if (try_shared(lock, &state)) {
+        return thrd_success;
+    }
+
+    struct timespec deadline = {0};
+    if (threads_compat_monotonic_deadline(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    return wait_shared(lock, &deadline);
+}
+
+int rwl_lock_exclusive(rwl_t *lock) {
+    unsigned int state = 0;
+    if (atomic_compare_exchange_strong_explicit(&lock->state, &state, WRITER, memory_order_acquire, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    return wait_exclusive(lock, NULL);
+}
+
+int rwl_trylock_exclusive(rwl_t *lock) {
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+    return try_exclusive(lock, &state) ? thrd_success : thrd_busy;
+}
+
+int rwl_timedlock_exclusive(rwl_t *lock, const struct timespec *time_point) {
+    unsigned int state = 0;
+    if (atomic_compare_exchange_strong_explicit(&lock->state, &state, WRITER, memory_order_acquire, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    struct timespec deadline = {0};
+    if (threads_compat_monotonic_deadline(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    return wait_exclusive(lock, &deadline);
+}
+
+int rwl_unlock(rwl_t *lock) {
+    // state cannot lose the writer bit or drop to zero readers while we hold the lock
+    unsigned int state = atomic_load_explicit(&lock->state, memory_order_relaxed);
+
+    if (state & WRITER) {
+        unsigned int previous = atomic_fetch_and_explicit(&lock->state, ~(WRITER | READERS_WAITING), memory_order_release);
+        if (previous & (WRITERS_WAITING | READERS_WAITING)) {
+            return wake(lock, previous & WRITERS_WAITING, previous & READERS_WAITING);
+        }
+
+        return thrd_success;
+    }
+
+    if (!(state & READERS_MASK)) {
+        report_error("rwl_unlock called for a lock not being held", EPERM);
+        return thrd_error;
+    }
+
+    unsigned int previous = atomic_fetch_sub_explicit(&lock->state, 1, memory_order_release);
+    if (((previous & READERS_MASK) == 1) && (previous & WRITERS_WAITING)) {
+        return wake(lock, true, false);
+    }
+
+    return thrd_success;
+}
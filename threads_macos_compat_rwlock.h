@@ -0,0 +1,84 @@
+#ifndef THREADS_MACOS_COMPAT_RWLOCK_H
+/**
+ * Reader-writer locks for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#define THREADS_MACOS_COMPAT_RWLOCK_H
+
+#include "threads_macos_compat.h"
+
+// state bits, the remaining lower bits count readers holding the lock
+#define THREADS_COMPAT_RWL_WRITER (1u << 31)
+#define THREADS_COMPAT_RWL_WRITERS_WAITING (1u << 30)
+#define THREADS_COMPAT_RWL_READERS_WAITING (1u << 29)
+#define THREADS_COMPAT_RWL_READERS_MASK (THREADS_COMPAT_RWL_READERS_WAITING - 1)
+
+// extension: reader-writer lock; uncontended shared and exclusive locking takes a single atomic operation, only
+// waiting involves the guard mutex; waiting writers take precedence over new readers
+typedef struct {
+    atomic_uint state;
+
+    // guards waiting, only locked if the lock is or may be contended
+    pthread_mutex_t guard;
+    pthread_cond_t readers;
+    pthread_cond_t writers;
+    unsigned int writers_waiting;
+} rwl_t;
+
+int rwl_init(rwl_t *lock);
+void rwl_destroy(rwl_t *lock);
+
+int rwl_lock_shared(rwl_t *lock);
+int rwl_trylock_shared(rwl_t *lock);
+int rwl_timedlock_shared(rwl_t *lock, const struct timespec *time_point);
+
+int rwl_lock_exclusive(rwl_t *lock);
+int rwl_trylock_exclusive(rwl_t *lock);
+int rwl_timedlock_exclusive(rwl_t *lock, const struct timespec *time_point);
+
+// releases either a shared or exclusive lock held by the calling thread
+int rwl_unlock(rwl_t *lock);
+
+#endif
@@ -0,0 +1,154 @@
+/**
+ * Counting semaphores for the C11 threads compatibility wrapper for the
+ * macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include <errno.h>
+#include <limits.h>
+
+#include "threads_macos_compat_sema.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+// Waiting threads register in waiters before checking count, posting threads check waiters after incrementing count.
+// Both use sequentially consistent operations, so either the waiter sees the new count or the poster sees the waiter.
+// Waiting on the address of count only blocks while it still is zero, so a wake up following the post cannot be missed.
+
+int sema_init(sema_t *semaphore, unsigned int count) {
+    atomic_init(&semaphore->count, count);
+    atomic_init(&semaphore->waiters, 0);
+
+    return thrd_success;
+}
+
+void sema_destroy(sema_t *semaphore) {
+    // nothing to release; waiting on an address does not hold any resources outside a wait
+    (void) semaphore;
+}
+
+static inline bool try_take(sema_t *semaphore, unsigned int *count) {
+    // count is the expected value and gets updated on failure
+    while (*count) {
+        if (atomic_compare_exchange_weak_explicit(&semaphore->count, count, *count - 1, memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int wait_until(sema_t *semaphore, const struct timespec *deadline) {
+    atomic_fetch_add(&semaphore->waiters, 1);
+
+    int res = thrd_success;
+    unsigned int count = atomic_load(&semaphore->count);
+    while (!try_take(semaphore, &count)) {
+        res = threads_compat_addr_wait_until(&semaphore->count, 0, deadline);
+        count = atomic_load(&semaphore->count);
+
+        if (res != thrd_success) {
+            // a post may have raced with the timeout; take it rather than leaving it to threads which were not woken
+            if ((res == thrd_timedout) && try_take(semaphore, &count)) {
+                res = thrd_success;
+            }
+
+            break;
+        }
+    }
+
+    atomic_fetch_sub_explicit(&semaphore->waiters, 1, memory_order_relaxed);
+
+    return res;
+}
+
+int sema_post(sema_t *semaphore) {
+    unsigned int count = atomic_load_explicit(&semaphore->count, memory_order_relaxed);
+    do {
+        if (count == UINT_MAX) {
+            report_error("sema_post", EOVERFLOW);
+            return thrd_error;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&semaphore->count, &count, count + 1, memory_order_seq_cst, memory_order_relaxed));
+
+    if (!atomic_load(&semaphore->waiters)) {
+        return thrd_success;
+    }
+
+    return addr_wake(&semaphore->count);
+}
+
+int sema_wait(sema_t *semaphore) {
+    unsigned int count = atomic_load_explicit(&semaphore->count, memory_order_relaxed);
+    if (try_take(semaphore, &count)) {
+        return thrd_success;
+    }
+
+    return wait_until(semaphore, NULL);
+}
+
+int sema_trywait(sema_t *semaphore) {
+    unsigned int count = atomic_load_explicit(&semaphore->count, memory_order_relaxed);
+    return try_take(semaphore, &count) ? thrd_success : thrd_busy;
+}
+
+int sema_timedwait(sema_t *semaphore, const struct timespec *time_point) {
+    unsigned int count = atomic_load_explicit(&semaphore->count, memory_order_relaxed);
+    if (try_take(semaphore, &count)) {
+        return thrd_success;
+    }
+
+    struct timespec deadline = {0};
+    if (threads_compat_monotonic_deadline(time_point, &deadline) != thrd_success) {
+        return thrd_error;
+    }
+
+    return wait_until(semaphore, &deadline);
+}
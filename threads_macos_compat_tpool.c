@@ -0,0 +1,443 @@
+/**
+ * Work-stealing thread pools for the C11 threads compatibility wrapper for
+ * the macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "threads_macos_compat_tpool.h"
+
+#ifdef THREADS_COMPAT_NO_ERROR_REPORTING
+#define report_error(site, err) ((void) 0)
+#else
+#define report_error(site, err) threads_compat_report_error((site), (err))
+#endif
+
+// number of tasks each worker can queue to its own deque (power of two), further tasks are shared with all workers
+#ifndef THREADS_COMPAT_TPOOL_DEQUE_SIZE
+#define THREADS_COMPAT_TPOOL_DEQUE_SIZE 1024
+#endif
+
+#define DEQUE_MASK (THREADS_COMPAT_TPOOL_DEQUE_SIZE - 1)
+
+// Each worker owns a Chase-Lev deque: the owner pushes and takes tasks at the bottom while other threads steal from
+// the top (memory orders as given by Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+//
+// Threads running out of work register as sleepers, issue a fence and only then look for tasks once more. Submitting
+// threads and completing groups issue a fence after publishing their change and only count up the event and wake if
+// they see sleepers; either the sleeper sees the change or the waker sees the sleeper. Waiting on the event address
+// only blocks while it still has the value read before looking for work, so no wake up can be missed.
+
+struct threads_compat_tpool_task {
+    tpool_func_t func;
+    void *arg;
+    tpool_group_t *group;
+    threads_compat_tpool_task_t *next;
+};
+
+struct threads_compat_tpool_worker {
+    // deque ends are written by different threads, kept on separate cache lines
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) atomic_ptrdiff_t top;
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) atomic_ptrdiff_t bottom;
+
+    _Alignas(THREADS_COMPAT_CACHE_LINE_SIZE) tpool_t *pool;
+    thrd_t thread;
+    unsigned int random;
+    _Atomic(threads_compat_tpool_task_t *) tasks[THREADS_COMPAT_TPOOL_DEQUE_SIZE];
+};
+
+static _Thread_local threads_compat_tpool_worker_t *current_worker = NULL;
+
+static bool deque_push(threads_compat_tpool_worker_t *worker, threads_compat_tpool_task_t *task) {
+    ptrdiff_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    ptrdiff_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    if (bottom - top >= THREADS_COMPAT_TPOOL_DEQUE_SIZE) {
+        return false;
+    }
+
+    atomic_store_explicit(&worker->tasks[bottom & DEQUE_MASK], task, memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_release);
+
+    return true;
+}
+
+static threads_compat_tpool_task_t* deque_take(threads_compat_tpool_worker_t *worker) {
+    ptrdiff_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    ptrdiff_t top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        // empty
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    threads_compat_tpool_task_t *task = atomic_load_explicit(&worker->tasks[bottom & DEQUE_MASK], memory_order_relaxed);
+    if (top == bottom) {
+        // last task, thieves may race for it
+        if (!atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return task;
+}
+
+static threads_compat_tpool_task_t* deque_steal(threads_compat_tpool_worker_t *worker, bool *contended) {
+    ptrdiff_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    ptrdiff_t bottom = atomic_load_explicit(&worker->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    threads_compat_tpool_task_t *task = atomic_load_explicit(&worker->tasks[top & DEQUE_MASK], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        // lost to the owner or another thief, the deque may still hold tasks
+        *contended = true;
+        return NULL;
+    }
+
+    return task;
+}
+
+static int inject(tpool_t *pool, threads_compat_tpool_task_t *task) {
+    if (mtx_lock(&pool->injected_mutex) != thrd_success) {
+        return thrd_error;
+    }
+
+    task->next = NULL;
+    if (pool->injected_tail) {
+        pool->injected_tail->next = task;
+    } else {
+        pool->injected_head = task;
+    }
+    pool->injected_tail = task;
+    atomic_fetch_add_explicit(&pool->num_injected, 1, memory_order_relaxed);
+
+    return mtx_unlock(&pool->injected_mutex);
+}
+
+static threads_compat_tpool_task_t* take_injected(tpool_t *pool) {
+    if (!atomic_load_explicit(&pool->num_injected, memory_order_relaxed)) {
+        return NULL;
+    }
+
+    if (mtx_lock(&pool->injected_mutex) != thrd_success) {
+        return NULL;
+    }
+
+    threads_compat_tpool_task_t *task = pool->injected_head;
+    if (task) {
+        pool->injected_head = task->next;
+        if (!pool->injected_head) {
+            pool->injected_tail = NULL;
+        }
+        atomic_fetch_sub_explicit(&pool->num_injected, 1, memory_order_relaxed);
+    }
+
+    mtx_unlock(&pool->injected_mutex);
+
+    return task;
+}
+
+static threads_compat_tpool_task_t* find_task(tpool_t *pool, threads_compat_tpool_worker_t *self) {
+    threads_compat_tpool_task_t *task = NULL;
+
+    if (self) {
+        task = deque_take(self);
+        if (task) {
+            return task;
+        }
+    }
+
+    task = take_injected(pool);
+    if (task) {
+        return task;
+    }
+
+    // start stealing at a random victim to spread thieves over the workers
+    unsigned int start = 0;
+    if (self) {
+        self->random ^= self->random << 13;
+        self->random ^= self->random >> 17;
+        self->random ^= self->random << 5;
+        start = self->random % pool->num_workers;
+    }
+
+    bool contended = false;
+    do {
+        contended = false;
+        for (unsigned int i = 0; i < pool->num_workers; i++) {
+            threads_compat_tpool_worker_t *victim = &pool->workers[(start + i) % pool->num_workers];
+            if (victim == self) {
+                continue;
+            }
+
+            task = deque_steal(victim, &contended);
+            if (task) {
+                return task;
+            }
+        }
+    } while (contended);
+
+    return NULL;
+}
+
+static int notify(tpool_t *pool, bool all) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&pool->sleepers, memory_order_relaxed)) {
+        return thrd_success;
+    }
+
+    atomic_fetch_add(&pool->event, 1);
+
+    return all ? addr_wake_all(&pool->event) : addr_wake(&pool->event);
+}
+
+static void run_task(tpool_t *pool, threads_compat_tpool_task_t *task) {
+    tpool_group_t *group = task->group;
+
+    task->func(task->arg);
+    free(task);
+
+    if (group && (atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel) == 1)) {
+        // we do not know which of the sleepers waits for the group
+        notify(pool, true);
+    }
+}
+
+static bool is_done(tpool_t *pool, tpool_group_t *group) {
+    if (group) {
+        return !atomic_load_explicit(&group->pending, memory_order_acquire);
+    }
+
+    return atomic_load(&pool->stopping);
+}
+
+static threads_compat_tpool_task_t* sleep_until_work(tpool_t *pool, threads_compat_tpool_worker_t *self, tpool_group_t *group, bool *waited, int *res) {
+    // returns a task if one shows up while registering as sleeper, otherwise waits unless done (group completed or
+    // pool stopping for workers) and returns NULL
+    atomic_fetch_add_explicit(&pool->sleepers, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    unsigned int event = atomic_load(&pool->event);
+    threads_compat_tpool_task_t *task = find_task(pool, self);
+    if (!task && !is_done(pool, group)) {
+        *res = threads_compat_addr_wait_until(&pool->event, event, NULL);
+        *waited = true;
+    }
+
+    atomic_fetch_sub_explicit(&pool->sleepers, 1, memory_order_relaxed);
+
+    return task;
+}
+
+static int worker_main(void *arg) {
+    threads_compat_tpool_worker_t *self = arg;
+    tpool_t *pool = self->pool;
+    current_worker = self;
+
+    while (true) {
+        threads_compat_tpool_task_t *task = find_task(pool, self);
+        if (!task) {
+            if (atomic_load(&pool->stopping)) {
+                break;
+            }
+
+            bool waited = false;
+            int res = thrd_success;
+            task = sleep_until_work(pool, self, NULL, &waited, &res);
+        }
+
+        if (task) {
+            run_task(pool, task);
+        }
+    }
+
+    current_worker = NULL;
+
+    return 0;
+}
+
+static void stop_workers(tpool_t *pool, unsigned int num_started) {
+    atomic_store(&pool->stopping, true);
+    notify(pool, true);
+
+    for (unsigned int i = 0; i < num_started; i++) {
+        thrd_join(pool->workers[i].thread, NULL);
+    }
+}
+
+int tpool_init(tpool_t *pool, unsigned int num_workers) {
+    if (!num_workers) {
+        long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_processors > 0) ? (unsigned int) num_processors : 1;
+    }
+
+    pool->num_workers = num_workers;
+    pool->injected_head = NULL;
+    pool->injected_tail = NULL;
+    atomic_init(&pool->num_injected, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->event, 0);
+    atomic_init(&pool->stopping, false);
+
+    void *workers = NULL;
+    int err = posix_memalign(&workers, THREADS_COMPAT_CACHE_LINE_SIZE, sizeof(threads_compat_tpool_worker_t) * num_workers);
+    if (err) {
+        report_error("tpool_init posix_memalign", err);
+        return (err == ENOMEM) ? thrd_nomem : thrd_error;
+    }
+    pool->workers = workers;
+
+    int res = mtx_init(&pool->injected_mutex, mtx_plain);
+    if (res != thrd_success) {
+        free(pool->workers);
+        return res;
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        threads_compat_tpool_worker_t *worker = &pool->workers[i];
+        atomic_init(&worker->top, 0);
+        atomic_init(&worker->bottom, 0);
+        worker->pool = pool;
+        worker->random = 2654435769u * (i + 1);
+        for (size_t j = 0; j < THREADS_COMPAT_TPOOL_DEQUE_SIZE; j++) {
+            atomic_init(&worker->tasks[j], NULL);
+        }
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        res = thrd_create(&pool->workers[i].thread, worker_main, &pool->workers[i]);
+        if (res != thrd_success) {
+            stop_workers(pool, i);
+            mtx_destroy(&pool->injected_mutex);
+            free(pool->workers);
+            return res;
+        }
+    }
+
+    return thrd_success;
+}
+
+void tpool_destroy(tpool_t *pool) {
+    stop_workers(pool, pool->num_workers);
+
+    mtx_destroy(&pool->injected_mutex);
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+int tpool_submit(tpool_t *pool, tpool_group_t *group, tpool_func_t func, void *arg) {
+    threads_compat_tpool_task_t *task = malloc(sizeof(threads_compat_tpool_task_t));
+    if (!task) {
+        report_error("tpool_submit malloc", ENOMEM);
+        return thrd_nomem;
+    }
+
+    task->func = func;
+    task->arg = arg;
+    task->group = group;
+
+    if (group) {
+        atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+    }
+
+    threads_compat_tpool_worker_t *self = current_worker;
+    if (!self || (self->pool != pool) || !deque_push(self, task)) {
+        if (inject(pool, task) != thrd_success) {
+            if (group) {
+                atomic_fetch_sub_explicit(&group->pending, 1, memory_order_relaxed);
+            }
+
+            free(task);
+            return thrd_error;
+        }
+    }
+
+    return notify(pool, false);
+}
+
+void tpool_group_init(tpool_group_t *group) {
+    atomic_init(&group->pending, 0);
+}
+
+int tpool_group_wait(tpool_t *pool, tpool_group_t *group) {
+    threads_compat_tpool_worker_t *self = current_worker;
+    if (self && (self->pool != pool)) {
+        self = NULL;
+    }
+
+    bool waited = false;
+    int res = thrd_success;
+    while ((res == thrd_success) && !is_done(pool, group)) {
+        threads_compat_tpool_task_t *task = find_task(pool, self);
+        if (!task) {
+            task = sleep_until_work(pool, self, group, &waited, &res);
+        }
+
+        if (task) {
+            run_task(pool, task);
+            waited = false;
+        }
+    }
+
+    if (waited) {
+        // the wake up may have been meant for a task we left behind, pass it on
+        notify(pool, false);
+    }
+
+    return res;
+}
@@ -0,0 +1,95 @@
+#ifndef THREADS_MACOS_COMPAT_TPOOL_H
+/**
+ * Work-stealing thread pools for the C11 threads compatibility wrapper for
+ * the macOS(r) operating system
+ * Copyright (c) 2024-2025 Daniel Neugebauer
+ * https://github.com/dneuge/c11-threads-compat-for-macos-operating-system
+ * 
+ * Released under MIT license, unless marked otherwise in the code that follows:
+ * 
+ * -----------------------------------------------------------------------------
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ * 
+ * Note that this file may only be used for AI training in accordance to the
+ * license shown above. AI models generally become derived projects by
+ * incorporating this file. At least play fair and release your models for free
+ * to give back to the community you are taking from.
+ * 
+ * 
+ * Mac and macOS are trademarks of Apple Inc., registered in the U.S. and other
+ * countries and regions.
+ * 
+ * 
+ * You are free to just copy this file to your project to ease dependency
+ * management. It is highly recommended to mark any changes you make with
+ * start/end comments incl. author/year/reason (+ license) for traceability and
+ * to keep those sections separate from the license and copyright stated by this
+ * comment. You probably also want to record the revision you copied into your
+ * project.
+ */
+
+#define THREADS_MACOS_COMPAT_TPOOL_H
+
+#include "threads_macos_compat.h"
+
+typedef void (*tpool_func_t)(void *arg);
+
+typedef struct threads_compat_tpool_task threads_compat_tpool_task_t;
+typedef struct threads_compat_tpool_worker threads_compat_tpool_worker_t;
+
+// extension: pool of worker threads, each running tasks from its own work-stealing deque and taking tasks from other
+// workers when running out of work; idle workers block (see addr_wait) until new tasks are submitted
+typedef struct {
+    threads_compat_tpool_worker_t *workers;
+    unsigned int num_workers;
+
+    // tasks submitted by threads outside the pool or not fitting into the deque of the submitting worker
+    mtx_t injected_mutex;
+    threads_compat_tpool_task_t *injected_head;
+    threads_compat_tpool_task_t *injected_tail;
+    atomic_size_t num_injected;
+
+    // threads waiting or about to wait for the event, which is only counted up while there are any
+    atomic_uint sleepers;
+    atomic_uint event;
+    atomic_bool stopping;
+} tpool_t;
+
+// tracks completion of the tasks submitted for it, may be reused once waited for
+typedef struct {
+    atomic_size_t pending;
+} tpool_group_t;
+
+// starts num_workers threads, 0 starts one per online processor
+int tpool_init(tpool_t *pool, unsigned int num_workers);
+
+// runs all remaining tasks, then stops and joins the workers; no tasks may be submitted from outside the pool anymore
+void tpool_destroy(tpool_t *pool);
+
+// group is optional; tasks submitted by workers are queued to their own deque, all others are shared
+int tpool_submit(tpool_t *pool, tpool_group_t *group, tpool_func_t func, void *arg);
+
+void tpool_group_init(tpool_group_t *group);
+
+// waits until all tasks of the group have completed; the calling thread runs queued tasks (of any group) meanwhile,
+// so tasks can wait for groups of tasks they submitted themselves (fork/join)
+int tpool_group_wait(tpool_t *pool, tpool_group_t *group);
+
+#endif